@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui #multimedia multimediawidgets
+QT       += core gui network #multimedia multimediawidgets
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -24,17 +24,35 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 CONFIG += c++11
 
+# Uncomment to count heap allocations of the capture loop per frame (see alloctracker.h).
+# Replaces global operator new/delete, so keep it off for release builds.
+#DEFINES += USBVIDEO_ALLOC_TRACKING
+
 #INCLUDEPATH += /usr/local/include/opencv4/
 #LIBS += -L /usr/local/lib/ -lopencv_core -lopencv_imgcodecs -lopencv_highgui
 
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
-    usbvideo.cpp
+    usbvideo.cpp \
+    alloctracker.cpp \
+    colorconvert.cpp \
+    temporaldenoise.cpp \
+    framehash.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
+    snapshotwriter.cpp
 
 HEADERS += \
         mainwindow.h \
-    usbvideo.h
+    usbvideo.h \
+    alloctracker.h \
+    colorconvert.h \
+    temporaldenoise.h \
+    framehash.h \
+    metrics.h \
+    metricsserver.h \
+    snapshotwriter.h
 
 FORMS += \
         mainwindow.ui
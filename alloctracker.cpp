@@ -0,0 +1,101 @@
+#include "alloctracker.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef USBVIDEO_ALLOC_TRACKING
+
+#ifndef __GLIBC__
+#error "USBVIDEO_ALLOC_TRACKING forwards to glibc's __libc_malloc and friends"
+#endif
+
+// CKim - glibc's own entry points. The definitions below live in the executable and
+// therefore interpose malloc for every shared library too (Qt, libjpeg, libstdc++,
+// whose operator new ends up here), which -Wl,--wrap would not. free() is not
+// replaced, the memory still comes from and goes back to the glibc heap.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+// CKim - Plain POD thread_local with the initial-exec model, so no dynamic
+// initialization or TLS allocation is needed and it is safe inside malloc itself.
+static thread_local alloc_counters t_counters __attribute__((tls_model("initial-exec"))) = { 0, 0 };
+
+static inline void count_alloc(size_t size)
+{
+    t_counters.count++;
+    t_counters.bytes += size;
+}
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size)
+{
+    count_alloc(num * size);
+    return __libc_calloc(num, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+    // CKim - realloc(p, 0) frees, everything else may hand out a new block
+    if (size)   {   count_alloc(size);  }
+    return __libc_realloc(p, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    count_alloc(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    count_alloc(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)))     {   return EINVAL;  }
+    count_alloc(size);
+    void* q = __libc_memalign(alignment, size);
+    if (!q)     {   return ENOMEM;  }
+    *p = q;
+    return 0;
+}
+
+}
+
+bool AllocTracker::isEnabled()
+{
+    return true;
+}
+
+alloc_counters AllocTracker::threadCounters()
+{
+    return t_counters;
+}
+
+#else
+
+bool AllocTracker::isEnabled()
+{
+    return false;
+}
+
+alloc_counters AllocTracker::threadCounters()
+{
+    alloc_counters c = { 0, 0 };
+    return c;
+}
+
+#endif
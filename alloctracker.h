@@ -0,0 +1,30 @@
+// --------------------------------------------------------------- //
+// CKim - Opt-in heap allocation counters.
+// When built with USBVIDEO_ALLOC_TRACKING defined, malloc, calloc, realloc and
+// the aligned variants are replaced (glibc only) and every allocation is counted
+// per thread, including those made inside Qt and libjpeg. Without the define
+// the counters always read zero and there is no overhead.
+// --------------------------------------------------------------- //
+
+#ifndef ALLOCTRACKER_H
+#define ALLOCTRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct alloc_counters {
+        uint64_t count;         // number of malloc family calls
+        uint64_t bytes;         // total bytes requested
+};
+
+namespace AllocTracker
+{
+    // CKim - True if the binary was built with USBVIDEO_ALLOC_TRACKING
+    bool isEnabled();
+
+    // CKim - Running totals of the calling thread. Take two snapshots and
+    // subtract to get the allocations made in between.
+    alloc_counters threadCounters();
+}
+
+#endif // ALLOCTRACKER_H
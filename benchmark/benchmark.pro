@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# Benchmark for the EndoscopeViewer video pipeline.
+# Build : qmake && make,  Run : ./EndoscopeBenchmark -platform offscreen
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = EndoscopeBenchmark
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp \
+    ../usbvideo.cpp \
+    ../alloctracker.cpp \
+    ../colorconvert.cpp \
+    ../temporaldenoise.cpp \
+    ../framehash.cpp \
+    ../metrics.cpp \
+    ../snapshotwriter.cpp
+
+HEADERS += \
+    ../usbvideo.h \
+    ../alloctracker.h \
+    ../colorconvert.h \
+    ../temporaldenoise.h \
+    ../framehash.h \
+    ../metrics.h \
+    ../snapshotwriter.h
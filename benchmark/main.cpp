@@ -0,0 +1,491 @@
+// --------------------------------------------------------------- //
+// CKim - Benchmark for the video pipeline.
+// Measures each stage in isolation and the whole UsbVideo pipeline fed from
+// a frame file. Prints one JSON object per line so results can be collected
+// and compared across releases and machines.
+// --------------------------------------------------------------- //
+
+#include <QApplication>
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QPixmap>
+#include <QSemaphore>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QVector>
+
+#include <algorithm>
+#include <math.h>
+
+#include "usbvideo.h"
+
+// CKim - Number of distinct frames per resolution in the generated corpus
+#define CORPUS_FRAMES   8
+
+// CKim - A pipeline run ends if no image arrives for this long
+#define PIPELINE_STALL_MS   10000
+
+static QElapsedTimer g_clock;
+
+struct corpus {
+        QString             name;
+        int                 width;
+        int                 height;
+        QVector<QByteArray> mjpeg;      // JPEG frames, as delivered by a MJPEG camera
+        QVector<QByteArray> yuyv;       // packed YUYV 4:2:2 frames
+        QVector<QByteArray> nv12;       // 4:2:0 Y plane + interleaved UV, as from a CSI / ISP node
+};
+
+// --------------------------------------------------------------- //
+// CKim - Corpus generation. Synthetic but endoscope-like : circular field
+// of view, reddish tissue texture, vignetting and sensor noise, so that JPEG
+// sizes and decode cost are in the range of real frames.
+// --------------------------------------------------------------- //
+
+static QImage makeFrame(int w, int h, int seed)
+{
+    QImage img(w, h, QImage::Format_RGB32);
+    unsigned int lcg = 12345u + seed * 7919u;
+    double cx = w / 2.0, cy = h / 2.0;
+    double radius = 0.48 * (w < h ? w : h) * 1.2;
+    double phase = seed * 0.35;
+
+    for (int y = 0; y < h; ++y)
+    {
+        QRgb* line = (QRgb*)img.scanLine(y);
+        for (int x = 0; x < w; ++x)
+        {
+            double dx = x - cx, dy = y - cy;
+            double r = sqrt(dx * dx + dy * dy) / radius;
+            if (r > 1.0) {  line[x] = qRgb(0, 0, 0);    continue;   }
+
+            lcg = lcg * 1664525u + 1013904223u;
+            int noise = (int)((lcg >> 24) & 0x1f) - 16;
+            double shade = 1.0 - 0.6 * r * r;
+            double tex = 0.5 + 0.25 * sin(x * 0.031 + phase) * cos(y * 0.027 - phase)
+                             + 0.15 * sin((x + y) * 0.11 + 2 * phase);
+            int red = (int)(220 * shade * (0.7 + 0.3 * tex)) + noise;
+            int grn = (int)(90 * shade * tex) + noise;
+            int blu = (int)(70 * shade * tex) + noise;
+            line[x] = qRgb(qBound(0, red, 255), qBound(0, grn, 255), qBound(0, blu, 255));
+        }
+    }
+    return img;
+}
+
+static QByteArray toYUYV(const QImage& img)
+{
+    int w = img.width(), h = img.height();
+    QByteArray out(w * h * 2, 0);
+    uchar* d = (uchar*)out.data();
+    for (int y = 0; y < h; ++y)
+    {
+        const QRgb* line = (const QRgb*)img.constScanLine(y);
+        for (int x = 0; x < w; x += 2, d += 4)
+        {
+            int yy[2], uu = 0, vv = 0;
+            for (int k = 0; k < 2; ++k)
+            {
+                int r = qRed(line[x + k]), g = qGreen(line[x + k]), b = qBlue(line[x + k]);
+                yy[k] = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+                uu   += ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+                vv   += ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+            }
+            d[0] = yy[0];   d[1] = uu / 2;  d[2] = yy[1];   d[3] = vv / 2;
+        }
+    }
+    return out;
+}
+
+static QByteArray toNV12(const QImage& img)
+{
+    // CKim - Chroma from the top left pixel of each 2x2 block is good enough for timing
+    int w = img.width(), h = img.height();
+    QByteArray out(w * h + w * ((h + 1) / 2), 0);
+    uchar* yp = (uchar*)out.data();
+    uchar* uv = yp + w * h;
+    for (int y = 0; y < h; ++y)
+    {
+        const QRgb* line = (const QRgb*)img.constScanLine(y);
+        for (int x = 0; x < w; ++x)
+        {
+            int r = qRed(line[x]), g = qGreen(line[x]), b = qBlue(line[x]);
+            yp[y * w + x] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            if (!(y & 1) && !(x & 1))
+            {
+                uv[(y / 2) * w + x]     = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+                uv[(y / 2) * w + x + 1] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+            }
+        }
+    }
+    return out;
+}
+
+static corpus makeCorpus(const QString& name, int w, int h)
+{
+    corpus c;
+    c.name = name;  c.width = w;    c.height = h;
+    for (int i = 0; i < CORPUS_FRAMES; ++i)
+    {
+        QImage img = makeFrame(w, h, i);
+        QByteArray jpg;
+        QBuffer buf(&jpg);
+        buf.open(QIODevice::WriteOnly);
+        img.save(&buf, "JPG", 85);
+        c.mjpeg.append(jpg);
+        c.yuyv.append(toYUYV(img));
+        c.nv12.append(toNV12(img));
+    }
+    return c;
+}
+
+// CKim - Same layout as UsbVideo::OpenFrameFile() : [4 byte LE length][payload] ...
+static bool writeFrameFile(const QString& path, const QVector<QByteArray>& frames)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate))    {   return false;   }
+    for (int i = 0; i < frames.size(); ++i)
+    {
+        quint32 len = frames[i].size();
+        char hdr[4] = { (char)(len & 0xff), (char)((len >> 8) & 0xff), (char)((len >> 16) & 0xff), (char)((len >> 24) & 0xff) };
+        f.write(hdr, 4);
+        f.write(frames[i]);
+    }
+    return true;
+}
+
+// --------------------------------------------------------------- //
+// CKim - Result output
+// --------------------------------------------------------------- //
+
+static void printResult(const char* stage, const char* format, const corpus& c,
+                        QVector<qint64> ns, qint64 totalNs = 0)
+{
+    if (ns.isEmpty())   {   return;     }
+    std::sort(ns.begin(), ns.end());
+
+    double sum = 0;
+    for (int i = 0; i < ns.size(); ++i)     {   sum += ns[i];   }
+    double mean = sum / ns.size();
+    qint64 p50 = ns[ns.size() / 2];
+    qint64 p99 = ns[qMin(ns.size() - 1, (int)(0.99 * ns.size()))];
+
+    // CKim - For the pipeline the wall clock over all frames is the honest fps
+    double fps = totalNs > 0 ? 1e9 * ns.size() / totalNs : 1e9 / mean;
+
+    printf("{\"stage\":\"%s\",\"format\":\"%s\",\"resolution\":\"%s\",\"width\":%d,\"height\":%d,"
+           "\"frames\":%d,\"fps\":%.2f,\"ns_per_frame\":%.0f,\"p50_ns\":%lld,\"p99_ns\":%lld,"
+           "\"max_ns\":%lld,\"arch\":\"%s\",\"qt\":\"%s\"}\n",
+           stage, format, qPrintable(c.name), c.width, c.height,
+           ns.size(), fps, mean, (long long)p50, (long long)p99, (long long)ns.last(),
+           qPrintable(QSysInfo::buildCpuArchitecture()), qVersion());
+    fflush(stdout);
+}
+
+// --------------------------------------------------------------- //
+// CKim - Stages in isolation
+// --------------------------------------------------------------- //
+
+static void benchJpegDecode(const corpus& c, int frames)
+{
+    // CKim - Same call the capture loop used before the image pool
+    QVector<qint64> ns;
+    QImage img;
+    for (int i = 0; i < frames; ++i)
+    {
+        const QByteArray& jpg = c.mjpeg[i % c.mjpeg.size()];
+        qint64 t0 = g_clock.nsecsElapsed();
+        img.loadFromData((const uchar*)jpg.constData(), jpg.size(), "JPG");
+        ns.append(g_clock.nsecsElapsed() - t0);
+    }
+    printResult("jpeg_decode", "MJPG", c, ns);
+}
+
+static void benchFrameHash(const corpus& c, int frames)
+{
+    // CKim - Cost of the repeated frame check paid on every MJPEG frame
+    QVector<qint64> ns;
+    uint64_t sink = 0;
+    for (int i = 0; i < frames; ++i)
+    {
+        const QByteArray& jpg = c.mjpeg[i % c.mjpeg.size()];
+        qint64 t0 = g_clock.nsecsElapsed();
+        sink ^= HashFrame(jpg.constData(), jpg.size());
+        ns.append(g_clock.nsecsElapsed() - t0);
+    }
+    if (sink == 1)  {   printf("\n");  }     // keep the hash from being optimized away
+    printResult("frame_hash", "MJPG", c, ns);
+}
+
+static void benchYUYVConvert(const corpus& c, int frames)
+{
+    QVector<qint64> ns;
+    QImage img(c.width, c.height, QImage::Format_RGB32);
+    for (int i = 0; i < frames; ++i)
+    {
+        const QByteArray& yuyv = c.yuyv[i % c.yuyv.size()];
+        qint64 t0 = g_clock.nsecsElapsed();
+        ConvertYUYVToRGB32((const uint8_t*)yuyv.constData(), c.width * 2, c.width, c.height,
+                           img.bits(), img.bytesPerLine());
+        ns.append(g_clock.nsecsElapsed() - t0);
+    }
+    printResult("yuyv_to_rgb32", "YUYV", c, ns);
+}
+
+static void benchNV12Convert(const corpus& c, int frames)
+{
+    QVector<qint64> ns;
+    QImage img(c.width, c.height, QImage::Format_RGB32);
+    for (int i = 0; i < frames; ++i)
+    {
+        const uint8_t* y = (const uint8_t*)c.nv12[i % c.nv12.size()].constData();
+        qint64 t0 = g_clock.nsecsElapsed();
+        ConvertNV12ToRGB32(y, c.width, y + c.width * c.height, c.width, false, c.width, c.height,
+                           img.bits(), img.bytesPerLine());
+        ns.append(g_clock.nsecsElapsed() - t0);
+    }
+    printResult("nv12_to_rgb32", "NV12", c, ns);
+}
+
+static void benchPixmap(const corpus& c, int frames)
+{
+    // CKim - What MainWindow::updatePixmap() does for every frame
+    QImage img;
+    img.loadFromData((const uchar*)c.mjpeg[0].constData(), c.mjpeg[0].size(), "JPG");
+
+    QVector<qint64> ns;
+    for (int i = 0; i < frames; ++i)
+    {
+        qint64 t0 = g_clock.nsecsElapsed();
+        QPixmap pixmap = QPixmap::fromImage(img);
+        ns.append(g_clock.nsecsElapsed() - t0);
+    }
+    printResult("pixmap_from_image", "RGB32", c, ns);
+}
+
+static void benchDenoise(const corpus& c, int frames)
+{
+    // CKim - Alternate between corpus frames so that every block sees a difference
+    QVector<QImage> decoded;
+    for (int i = 0; i < c.mjpeg.size(); ++i)
+    {
+        QImage img;
+        img.loadFromData((const uchar*)c.mjpeg[i].constData(), c.mjpeg[i].size(), "JPG");
+        decoded.append(img.convertToFormat(QImage::Format_RGB32));
+    }
+
+    TemporalDenoiser denoiser;
+    QImage work = decoded[0];
+    denoiser.Process(work.bits(), work.bytesPerLine(), work.width(), work.height());
+
+    QVector<qint64> ns;
+    for (int i = 0; i < frames; ++i)
+    {
+        work = decoded[i % decoded.size()].copy();
+        qint64 t0 = g_clock.nsecsElapsed();
+        denoiser.Process(work.bits(), work.bytesPerLine(), work.width(), work.height());
+        ns.append(g_clock.nsecsElapsed() - t0);
+    }
+    printResult("temporal_denoise", "RGB32", c, ns);
+}
+
+// CKim - Cross thread handoff. One frame in flight at a time, so the
+// measured time is the queued signal latency and not a growing backlog.
+class HandoffSender : public QThread
+{
+    Q_OBJECT
+public:
+    HandoffSender(const QImage& img, int frames, QSemaphore* ack)
+        : m_image(img), m_frames(frames), m_ack(ack) {}
+signals:
+    void frame(const QImage& image, qint64 sentNs);
+protected:
+    void run() override
+    {
+        for (int i = 0; i < m_frames; ++i)
+        {
+            m_ack->acquire();
+            emit frame(m_image, g_clock.nsecsElapsed());
+        }
+    }
+private:
+    QImage      m_image;
+    int         m_frames;
+    QSemaphore* m_ack;
+};
+
+class HandoffReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    HandoffReceiver(int frames, QSemaphore* ack) : m_frames(frames), m_ack(ack) {}
+    QVector<qint64> ns;
+signals:
+    void done();
+public slots:
+    void onFrame(const QImage&, qint64 sentNs)
+    {
+        ns.append(g_clock.nsecsElapsed() - sentNs);
+        m_ack->release();
+        if (ns.size() == m_frames)  {   emit done();    }
+    }
+private:
+    int         m_frames;
+    QSemaphore* m_ack;
+};
+
+static void benchHandoff(const corpus& c, int frames)
+{
+    QImage img(c.width, c.height, QImage::Format_RGB32);
+    QSemaphore ack(1);
+    HandoffSender sender(img, frames, &ack);
+    HandoffReceiver receiver(frames, &ack);
+    QEventLoop loop;
+    QObject::connect(&sender, SIGNAL(frame(QImage,qint64)), &receiver, SLOT(onFrame(QImage,qint64)));
+    QObject::connect(&receiver, SIGNAL(done()), &loop, SLOT(quit()));
+    sender.start();
+    loop.exec();
+    sender.wait();
+    printResult("signal_handoff", "RGB32", c, receiver.ns);
+}
+
+// --------------------------------------------------------------- //
+// CKim - End to end through UsbVideo with the file-fed source.
+// The sink does what MainWindow::updatePixmap() does. Frames that fail to
+// decode or are skipped as repeated never arrive, so the run ends when the
+// capture thread finishes, or when the watchdog sees no image for a while.
+// --------------------------------------------------------------- //
+
+class PipelineSink : public QObject
+{
+    Q_OBJECT
+public:
+    PipelineSink(int frames) : m_frames(frames), m_count(0), m_first(0), m_last(0)
+    {
+        m_watchdog.setSingleShot(true);
+        m_watchdog.setInterval(PIPELINE_STALL_MS);
+        connect(&m_watchdog, SIGNAL(timeout()), this, SIGNAL(done()));
+        m_watchdog.start();
+    }
+    QVector<qint64> ns;
+    qint64 totalNs()    {   return m_last - m_first;    }
+    int received()      {   return m_count;     }
+    bool stalled()      {   return !m_watchdog.isActive() && m_count < m_frames;    }
+signals:
+    void done();
+public slots:
+    void onImage(const QImage& image)
+    {
+        QPixmap pixmap = QPixmap::fromImage(image);
+        qint64 now = g_clock.nsecsElapsed();
+        if (m_count == 0)   {   m_first = now;  }
+        else                {   ns.append(now - m_last);    }
+        m_last = now;
+        m_watchdog.start();
+        if (++m_count == m_frames)  {   m_watchdog.stop();  emit done();    }
+    }
+private:
+    int     m_frames;
+    int     m_count;
+    qint64  m_first;
+    qint64  m_last;
+    QTimer  m_watchdog;
+};
+
+static void benchPipeline(const corpus& c, int frames, const QString& dir, unsigned int pixelformat)
+{
+    const char* format = "MJPG";
+    const char* stage = "pipeline_mjpeg";
+    const QVector<QByteArray>* data = &c.mjpeg;
+    if (pixelformat == V4L2_PIX_FMT_YUYV)       {   format = "YUYV";    stage = "pipeline_yuyv";    data = &c.yuyv;     }
+    else if (pixelformat == V4L2_PIX_FMT_NV12)  {   format = "NV12";    stage = "pipeline_nv12";    data = &c.nv12;     }
+    else if (pixelformat == V4L2_PIX_FMT_NV12M) {   format = "NV12M";   stage = "pipeline_nv12m";   data = &c.nv12;     }
+
+    QString path = QDir(dir).filePath(QString("%1_%2.frames").arg(c.name).arg(QString(format).toLower()));
+    if (!writeFrameFile(path, *data))
+    {
+        fprintf(stderr, "Cannot write %s\n", qPrintable(path));
+        return;
+    }
+
+    UsbVideo video;
+    if (!video.OpenFrameFile(path.toLocal8Bit().constData(), c.width, c.height,
+                             pixelformat, 0, frames) ||
+        !video.InitializeDevice(IO_METHOD_FILE))
+    {
+        fprintf(stderr, "%s\n", qPrintable(video.GetErrStr()));
+        return;
+    }
+
+    PipelineSink sink(frames);
+    QEventLoop loop;
+    QObject::connect(&video, SIGNAL(renderedImage(QImage)), &sink, SLOT(onImage(QImage)));
+    QObject::connect(&sink, SIGNAL(done()), &loop, SLOT(quit()));
+    // CKim - Queued behind the images already emitted, so none of them is lost
+    QObject::connect(&video, SIGNAL(finished()), &loop, SLOT(quit()));
+    video.StartCapture();
+    loop.exec();
+    video.StopCapture();
+    video.CloseDevice();
+
+    // CKim - The result covers the frames actually received, not the ones requested
+    if (sink.received() < frames)
+    {
+        fprintf(stderr, "%s %s : received %d of %d frames%s\n", stage, qPrintable(c.name),
+                sink.received(), frames, sink.stalled() ? ", stalled" : "");
+    }
+    printResult(stage, format, c, sink.ns, sink.totalNs());
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    g_clock.start();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("EndoscopeViewer pipeline benchmark. Prints one JSON object per line.");
+    parser.addHelpOption();
+    QCommandLineOption framesOption("frames", "Frames per measurement.", "n", "300");
+    QCommandLineOption corpusOption("write-corpus", "Also write the frame files to this directory.", "dir");
+    QCommandLineOption resOption("resolution", "Only run 480p, 720p or 1080p.", "name");
+    parser.addOption(framesOption);
+    parser.addOption(corpusOption);
+    parser.addOption(resOption);
+    parser.process(a);
+
+    int frames = qMax(2, parser.value(framesOption).toInt());
+
+    QTemporaryDir tmpDir;
+    QString dir = parser.isSet(corpusOption) ? parser.value(corpusOption) : tmpDir.path();
+    QDir().mkpath(dir);
+
+    struct { const char* name; int w; int h; } sizes[] = {
+        { "480p", 640, 480 }, { "720p", 1280, 720 }, { "1080p", 1920, 1080 } };
+
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        if (parser.isSet(resOption) && parser.value(resOption) != sizes[i].name)   {   continue;   }
+
+        corpus c = makeCorpus(sizes[i].name, sizes[i].w, sizes[i].h);
+        benchJpegDecode(c, frames);
+        benchFrameHash(c, frames);
+        benchYUYVConvert(c, frames);
+        benchNV12Convert(c, frames);
+        benchPixmap(c, frames);
+        benchDenoise(c, frames);
+        benchHandoff(c, frames);
+        benchPipeline(c, frames, dir, V4L2_PIX_FMT_MJPEG);
+        benchPipeline(c, frames, dir, V4L2_PIX_FMT_YUYV);
+        benchPipeline(c, frames, dir, V4L2_PIX_FMT_NV12);
+        benchPipeline(c, frames, dir, V4L2_PIX_FMT_NV12M);
+    }
+
+    return 0;
+}
+
+#include "main.moc"
@@ -0,0 +1,79 @@
+#include "colorconvert.h"
+
+// CKim - BT.601 coefficients scaled by 2^8
+//   R = 1.164(Y-16) + 1.596(V-128)
+//   G = 1.164(Y-16) - 0.392(U-128) - 0.813(V-128)
+//   B = 1.164(Y-16) + 2.017(U-128)
+static inline uint8_t clamp255(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static inline uint32_t yuv_to_rgb32(int y, int ruv, int guv, int buv)
+{
+    int c = 298 * (y - 16) + 128;
+    return 0xff000000u
+         | ((uint32_t)clamp255((c + ruv) >> 8) << 16)
+         | ((uint32_t)clamp255((c + guv) >> 8) << 8)
+         |  (uint32_t)clamp255((c + buv) >> 8);
+}
+
+// CKim - Shared 4:2:0 loop. Chroma samples are 'step' bytes apart, 1 for planar, 2 for interleaved.
+static void convert420(const uint8_t* y, int yStride, const uint8_t* u, const uint8_t* v,
+                       int uvStride, int step, int width, int height, uint8_t* dst, int dstStride)
+{
+    for (int row = 0; row < height; ++row)
+    {
+        const uint8_t* ys = y + row * yStride;
+        const uint8_t* us = u + (row >> 1) * uvStride;
+        const uint8_t* vs = v + (row >> 1) * uvStride;
+        uint32_t* d = (uint32_t*)(dst + row * dstStride);
+
+        for (int x = 0; x < width; x += 2, us += step, vs += step)
+        {
+            int cu = *us - 128;
+            int cv = *vs - 128;
+            int ruv = 409 * cv;
+            int guv = -100 * cu - 208 * cv;
+            int buv = 516 * cu;
+            d[x] = yuv_to_rgb32(ys[x], ruv, guv, buv);
+            if (x + 1 < width)  {   d[x + 1] = yuv_to_rgb32(ys[x + 1], ruv, guv, buv);  }
+        }
+    }
+}
+
+void ConvertNV12ToRGB32(const uint8_t* y, int yStride, const uint8_t* uv, int uvStride,
+                        bool vFirst, int width, int height, uint8_t* dst, int dstStride)
+{
+    const uint8_t* u = vFirst ? uv + 1 : uv;
+    const uint8_t* v = vFirst ? uv : uv + 1;
+    convert420(y, yStride, u, v, uvStride, 2, width, height, dst, dstStride);
+}
+
+void ConvertYUV420ToRGB32(const uint8_t* y, int yStride, const uint8_t* u, const uint8_t* v, int uvStride,
+                          int width, int height, uint8_t* dst, int dstStride)
+{
+    convert420(y, yStride, u, v, uvStride, 1, width, height, dst, dstStride);
+}
+
+void ConvertYUYVToRGB32(const uint8_t* src, int srcStride, int width, int height,
+                        uint8_t* dst, int dstStride)
+{
+    for (int row = 0; row < height; ++row)
+    {
+        const uint8_t* s = src + row * srcStride;
+        uint32_t* d = (uint32_t*)(dst + row * dstStride);
+
+        // CKim - Two pixels share one U and one V sample : Y0 U Y1 V
+        for (int x = 0; x < width; x += 2, s += 4)
+        {
+            int u = s[1] - 128;
+            int v = s[3] - 128;
+            int ruv = 409 * v;
+            int guv = -100 * u - 208 * v;
+            int buv = 516 * u;
+            d[x]     = yuv_to_rgb32(s[0], ruv, guv, buv);
+            d[x + 1] = yuv_to_rgb32(s[2], ruv, guv, buv);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+// --------------------------------------------------------------- //
+// CKim - Pixel format conversion from raw V4L2 formats to 32 bit RGB
+// (0xffRRGGBB, same layout as QImage::Format_RGB32).
+// Fixed point BT.601 limited range, as produced by UVC cameras.
+// --------------------------------------------------------------- //
+
+#ifndef COLORCONVERT_H
+#define COLORCONVERT_H
+
+#include <stdint.h>
+
+// CKim - Packed YUYV 4:2:2 (V4L2_PIX_FMT_YUYV). Width must be even.
+void ConvertYUYVToRGB32(const uint8_t* src, int srcStride, int width, int height,
+                        uint8_t* dst, int dstStride);
+
+// CKim - 4:2:0 with interleaved chroma. NV12 (V4L2_PIX_FMT_NV12, NV12M) is U first,
+// NV21 is V first. uv points to the chroma plane.
+void ConvertNV12ToRGB32(const uint8_t* y, int yStride, const uint8_t* uv, int uvStride,
+                        bool vFirst, int width, int height, uint8_t* dst, int dstStride);
+
+// CKim - 4:2:0 fully planar (V4L2_PIX_FMT_YUV420, YUV420M), U plane then V plane.
+void ConvertYUV420ToRGB32(const uint8_t* y, int yStride, const uint8_t* u, const uint8_t* v, int uvStride,
+                          int width, int height, uint8_t* dst, int dstStride);
+
+#endif // COLORCONVERT_H
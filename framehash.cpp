@@ -0,0 +1,150 @@
+#include "framehash.h"
+
+#include <string.h>
+
+// CKim - The CRC32C path is compiled for the instruction with a target attribute and
+// picked at run time, so a build for the baseline ISA (x86-64, ARMv6/v7 Raspberry Pi
+// OS, generic ARMv8) still uses it on CPUs that have it.
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define FRAMEHASH_CRC32C_TARGET     __attribute__((target("sse4.2")))
+#define FRAMEHASH_CRC32C(crc, v)    _mm_crc32_u64((crc), (v))
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32                 (1 << 7)
+#endif
+#define FRAMEHASH_CRC32C_TARGET     __attribute__((target("arch=armv8-a+crc")))
+#define FRAMEHASH_CRC32C(crc, v)    __crc32cd((uint32_t)(crc), (v))
+#elif defined(__arm__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef AT_HWCAP2
+#define AT_HWCAP2                   26
+#endif
+#ifndef HWCAP2_CRC32
+#define HWCAP2_CRC32                (1 << 4)
+#endif
+#define FRAMEHASH_CRC32C_TARGET     __attribute__((target("arch=armv8-a+crc")))
+#define FRAMEHASH_CRC32C(crc, v)    crc32c_u64((uint32_t)(crc), (v))
+
+// CKim - AArch32 has no 64 bit form, ARMv8 CPUs running a 32 bit OS take two steps
+static inline FRAMEHASH_CRC32C_TARGET uint32_t crc32c_u64(uint32_t crc, uint64_t v)
+{
+    return __crc32cw(__crc32cw(crc, (uint32_t)v), (uint32_t)(v >> 32));
+}
+#endif
+
+static inline uint64_t read64(const uint8_t* p)
+{
+    // CKim - memcpy compiles to a single unaligned load
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;   h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;   h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+#if defined(FRAMEHASH_CRC32C)
+
+static FRAMEHASH_CRC32C_TARGET uint64_t hash_crc32c(const void* data, size_t length)
+{
+    // CKim - Independent lanes hide the 3 cycle latency of the crc instruction.
+    // Two lanes go to the high and two to the low 32 bits of the result.
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t a = 0x9e3779b9, b = 0x85ebca6b, c = 0xc2b2ae35, d = 0x27d4eb2f;
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        a = FRAMEHASH_CRC32C(a, read64(p + i));
+        b = FRAMEHASH_CRC32C(b, read64(p + i + 8));
+        c = FRAMEHASH_CRC32C(c, read64(p + i + 16));
+        d = FRAMEHASH_CRC32C(d, read64(p + i + 24));
+    }
+    for (; i + 8 <= length; i += 8)     {   a = FRAMEHASH_CRC32C(a, read64(p + i));     }
+
+    uint64_t tail = 0;
+    if (i < length)
+    {
+        memcpy(&tail, p + i, length - i);
+        b = FRAMEHASH_CRC32C(b, tail);
+    }
+
+    uint64_t hi = (uint32_t)a ^ ((uint32_t)c << 7 | (uint32_t)c >> 25);
+    uint64_t lo = (uint32_t)b ^ ((uint32_t)d << 13 | (uint32_t)d >> 19);
+    return mix64((hi << 32 | lo) ^ length);
+}
+
+#endif
+
+static const uint64_t P1 = 0x9e3779b185ebca87ULL;
+static const uint64_t P2 = 0xc2b2ae3d27d4eb4fULL;
+
+static inline uint64_t round64(uint64_t acc, uint64_t v)
+{
+    acc += v * P2;
+    return rotl64(acc, 31) * P1;
+}
+
+static uint64_t hash_mulrot(const void* data, size_t length)
+{
+    // CKim - Four accumulators consume 32 bytes per iteration with no dependency
+    // between them, so the multiplies overlap in the pipeline
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t a = P1 + P2, b = P2, c = 0, d = 0 - P1;
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        a = round64(a, read64(p + i));
+        b = round64(b, read64(p + i + 8));
+        c = round64(c, read64(p + i + 16));
+        d = round64(d, read64(p + i + 24));
+    }
+
+    uint64_t h = rotl64(a, 1) + rotl64(b, 7) + rotl64(c, 12) + rotl64(d, 18);
+    h ^= length;
+    for (; i + 8 <= length; i += 8)     {   h = rotl64(h ^ round64(0, read64(p + i)), 27) * P1;    }
+
+    if (i < length)
+    {
+        uint64_t tail = 0;
+        memcpy(&tail, p + i, length - i);
+        h = rotl64(h ^ round64(0, tail), 27) * P1;
+    }
+    return mix64(h);
+}
+
+typedef uint64_t (*hash_func)(const void* data, size_t length);
+
+static hash_func pick_hash()
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))          {   return hash_crc32c;     }
+#elif defined(__aarch64__) && defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32)         {   return hash_crc32c;     }
+#elif defined(__arm__) && defined(__linux__)
+    if (getauxval(AT_HWCAP2) & HWCAP2_CRC32)       {   return hash_crc32c;     }
+#endif
+    return hash_mulrot;
+}
+
+uint64_t HashFrame(const void* data, size_t length)
+{
+    // CKim - Resolved once, then a plain indirect call per frame
+    static const hash_func hash = pick_hash();
+    return hash(data, length);
+}
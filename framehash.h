@@ -0,0 +1,17 @@
+// --------------------------------------------------------------- //
+// CKim - Fast 64 bit content hash used to spot repeated frames.
+// Not cryptographic. Uses hardware CRC32C when the CPU has it (SSE4.2, or
+// the ARMv8 CRC extension in 64 or 32 bit mode), detected at run time,
+// otherwise a 4 lane multiply-rotate hash.
+// Values differ between the two paths, only compare within one process.
+// --------------------------------------------------------------- //
+
+#ifndef FRAMEHASH_H
+#define FRAMEHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t HashFrame(const void* data, size_t length);
+
+#endif // FRAMEHASH_H
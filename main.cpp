@@ -1,11 +1,117 @@
 #include "mainwindow.h"
+#include "metricsserver.h"
 #include <QApplication>
+#include <QCommandLineParser>
+
+#include <stdio.h>
+#include <unistd.h>
+
+// CKim - CPU numbers accepted for pinning, CPU_SET() on anything outside is undefined
+static bool isValidCpu(int cpu)
+{
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    return cpu >= 0 && cpu < count && cpu < CPU_SETSIZE;
+}
+
+// CKim - "1-3,5" style list as taskset takes it. Empty leaves the set empty.
+static bool parseCpuList(const QString& str, cpu_set_t* cpus)
+{
+    CPU_ZERO(cpus);
+    if (str.isEmpty())  {   return true;    }
+
+    const QStringList parts = str.split(',');
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        QStringList range = parts[i].split('-');
+        bool okFirst = false, okLast = false;
+        int first = range[0].toInt(&okFirst);
+        int last = range.size() == 2 ? range[1].toInt(&okLast) : first;
+        if (range.size() == 1)  {   okLast = okFirst;   }
+        if (!okFirst || !okLast || range.size() > 2 || first > last ||
+            !isValidCpu(first) || !isValidCpu(last))    {   return false;   }
+        for (int cpu = first; cpu <= last; ++cpu)       {   CPU_SET(cpu, cpus);     }
+    }
+    return true;
+}
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    MainWindow w;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption deviceOption("device", "V4L2 capture device, single or multi-planar.", "path", "/dev/video0");
+    parser.addOption(deviceOption);
+
+    // CKim - Real-time options for the capture thread
+    QCommandLineOption schedOption("sched", "Capture thread policy: other, fifo or rr.", "policy", "other");
+    QCommandLineOption prioOption("rt-priority", "Priority for fifo / rr, 1-99.", "priority", "50");
+    QCommandLineOption cpuOption("capture-cpu", "Pin the capture thread to this CPU.", "cpu", "-1");
+    QCommandLineOption decodeCpuOption("decode-cpus", "CPUs for the denoise workers, e.g. 1-3.", "list");
+    QCommandLineOption mlockOption("mlock", "Lock process memory with mlockall().");
+    QCommandLineOption prefaultOption("prefault", "Prefault the mmap buffers.");
+    QCommandLineOption frozenOption("frozen-frames", "Identical frames before the stream is flagged frozen, 0 never.", "n", "30");
+    QCommandLineOption denoiseOption("denoise", "Start with temporal noise reduction, strength 1-100.", "strength", "0");
+    parser.addOption(schedOption);
+    parser.addOption(prioOption);
+    parser.addOption(cpuOption);
+    parser.addOption(decodeCpuOption);
+    parser.addOption(mlockOption);
+    parser.addOption(prefaultOption);
+    parser.addOption(denoiseOption);
+    parser.addOption(frozenOption);
+
+    // CKim - Pipeline statistics, see metrics.h
+    QCommandLineOption metricsOption("metrics-port", "Serve Prometheus metrics on 127.0.0.1:port, 0 off.", "port", "0");
+    QCommandLineOption overlayOption("overlay", "Start with the statistics overlay on the video.");
+    parser.addOption(metricsOption);
+    parser.addOption(overlayOption);
+
+    // CKim - Stills taken with the Snapshot button
+    QCommandLineOption snapDirOption("snapshot-dir", "Directory for snapshots.", "dir", ".");
+    QCommandLineOption snapBurstOption("snapshot-burst", "Keep the sharpest of this many frames.", "n", "5");
+    parser.addOption(snapDirOption);
+    parser.addOption(snapBurstOption);
+    parser.process(a);
+
+    rt_config rt;
+    QString sched = parser.value(schedOption);
+    if (sched == "fifo")        {   rt.policy = SCHED_FIFO;     }
+    else if (sched == "rr")     {   rt.policy = SCHED_RR;       }
+    else                        {   rt.policy = SCHED_OTHER;    }
+    rt.priority = parser.value(prioOption).toInt();
+    bool cpuOk = false;
+    rt.captureCpu = parser.value(cpuOption).toInt(&cpuOk);
+    if (!cpuOk || (rt.captureCpu != -1 && !isValidCpu(rt.captureCpu)))
+    {
+        fprintf(stderr, "--capture-cpu %s : expected -1 or a CPU from 0 to %ld\n",
+                parser.value(cpuOption).toLocal8Bit().constData(), sysconf(_SC_NPROCESSORS_CONF) - 1);
+        return 1;
+    }
+    if (!parseCpuList(parser.value(decodeCpuOption), &rt.decodeCpus))
+    {
+        fprintf(stderr, "--decode-cpus %s : expected a list like 1-3,5 of CPUs from 0 to %ld\n",
+                parser.value(decodeCpuOption).toLocal8Bit().constData(), sysconf(_SC_NPROCESSORS_CONF) - 1);
+        return 1;
+    }
+    rt.lockMemory = parser.isSet(mlockOption);
+    rt.prefault = parser.isSet(prefaultOption);
+
+    MainWindow w(parser.value(deviceOption));
+    w.SetRealtimeConfig(rt);
+    w.SetFrozenThreshold(parser.value(frozenOption).toInt());
+    if (parser.value(denoiseOption).toInt() > 0)    {   w.SetDenoiseStrength(parser.value(denoiseOption).toInt());  }
+    w.SetOverlay(parser.isSet(overlayOption));
+    w.SetSnapshotConfig(parser.value(snapDirOption), parser.value(snapBurstOption).toInt());
     w.show();
 
+    MetricsServer metrics;
+    int port = parser.value(metricsOption).toInt();
+    if (port > 0)
+    {
+        if (!metrics.Start(port))   {   fprintf(stderr, "%s\n", metrics.GetErrStr().toLocal8Bit().constData());   }
+        else                        {   printf("%s\n", metrics.GetMsgStr().toLocal8Bit().constData());            }
+    }
+
     return a.exec();
 }
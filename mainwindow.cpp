@@ -1,18 +1,28 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include <QDateTime>
+#include <QPainter>
 
 
-MainWindow::MainWindow(QWidget *parent) :
+
+MainWindow::MainWindow(const QString& device, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
+    m_denoiseStrength = 50;
+    m_snapshotDir = ".";
+    m_snapshotBurst = 1;
+    m_overlay = false;
+    m_overlayDisplayed = 0;
+    m_overlayDecodeNs = 0;
+    m_overlayDecoded = 0;
 
     // CKim - Open Video
     m_Video = new UsbVideo();
     //int ret = m_Video->OpenDevice("/dev/video2");
-    int ret = m_Video->OpenDevice("/dev/video0");
+    int ret = m_Video->OpenDevice(device.toLocal8Bit().constData());
     if(!ret)    {
         ui->lblMsg->setText(m_Video->GetErrStr());    }
     else {
@@ -20,6 +30,9 @@ MainWindow::MainWindow(QWidget *parent) :
 
     connect(m_Video, SIGNAL(reportError(QString)), this, SLOT(printError(QString)));
     connect(m_Video, SIGNAL(timeoutError()), this, SLOT(recoverfromTimeout()));
+    connect(m_Video, SIGNAL(frozenStream(int)), this, SLOT(reportFrozen(int)));
+    connect(m_Video, SIGNAL(streamResumed()), this, SLOT(reportResumed()));
+    connect(m_Video, SIGNAL(snapshotSaved(QString)), this, SLOT(reportSnapshot(QString)));
 }
 
 MainWindow::~MainWindow()
@@ -43,7 +56,7 @@ void MainWindow::on_btnInit_clicked()
 
 void MainWindow::on_btnStart_clicked()
 {
-    connect(m_Video, SIGNAL(renderedImage(QImage)), this, SLOT(updatePixmap(QImage)));
+    connect(m_Video, SIGNAL(renderedImage(QImage)), this, SLOT(updatePixmap(QImage)), Qt::UniqueConnection);
     int ret = m_Video->StartCapture();
     if(!ret)    {
         ui->lblMsg->setText(m_Video->GetErrStr());    }
@@ -58,6 +71,7 @@ void MainWindow::on_btnStop_clicked()
         ui->lblMsg->setText(m_Video->GetErrStr());    }
     else {
         ui->lblMsg->setText(m_Video->GetMsgStr());    }
+    m_Video->PrintJitterReport();
 
     ret = m_Video->ClearBuffer();
     if(!ret)    {
@@ -66,21 +80,115 @@ void MainWindow::on_btnStop_clicked()
         ui->lblMsg->setText(m_Video->GetMsgStr());    }
 }
 
+void MainWindow::SetDenoiseStrength(int strength)
+{
+    // CKim - Remember the strength for the checkbox, 0 only unchecks it
+    if (strength > 0)   {   m_denoiseStrength = strength;   }
+    ui->chkDenoise->setChecked(strength > 0);
+    m_Video->SetDenoiseStrength(strength);
+}
+
+void MainWindow::on_chkDenoise_toggled(bool checked)
+{
+    m_Video->SetDenoiseStrength(checked ? m_denoiseStrength : 0);
+}
+
+void MainWindow::on_btnSnapshot_clicked()
+{
+    // CKim - Preview keeps running, the file is written by the snapshot thread
+    QString name = QString("%1/snapshot_%2.jpg").arg(m_snapshotDir)
+            .arg(QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss_zzz"));
+    int ret = m_Video->RequestSnapshot(name, m_snapshotBurst);
+    if(!ret)    {
+        ui->lblMsg->setText(m_Video->GetErrStr());    }
+    else {
+        ui->lblMsg->setText(m_Video->GetMsgStr());    }
+}
+
+void MainWindow::reportSnapshot(const QString& path)
+{
+    ui->lblMsg->setText(QString("Saved %1").arg(path));
+}
+
+void MainWindow::SetOverlay(bool on)
+{
+    ui->chkOverlay->setChecked(on);
+    m_overlay = on;
+}
+
+void MainWindow::on_chkOverlay_toggled(bool checked)
+{
+    m_overlay = checked;
+    m_overlayText.clear();
+}
+
 void MainWindow::updatePixmap(const QImage &image)
 {
     // https://doc.qt.io/qt-5/qtwidgets-widgets-imageviewer-example.html
     QPixmap pixmap = QPixmap::fromImage(image);
+    Metrics::Add(METRIC_FRAMES_DISPLAYED);
+    Metrics::Add(METRIC_DISPLAY_QUEUE, -1);
+
+    if (m_overlay)  {   drawOverlay(pixmap);    }
     ui->lblImage->setPixmap(pixmap);
 }
 
+void MainWindow::updateOverlayText()
+{
+    // CKim - Rates are computed over the interval since the previous update
+    int64_t displayed = Metrics::Get(METRIC_FRAMES_DISPLAYED);
+    int64_t decoded = Metrics::Get(METRIC_FRAMES_DECODED);
+    int64_t decodeNs = Metrics::Get(METRIC_DECODE_NS_TOTAL);
+    double sec = m_overlayTimer.isValid() ? m_overlayTimer.restart() / 1000.0 : 0;
+    if (!m_overlayTimer.isValid())  {   m_overlayTimer.start();     }
+
+    double fps = sec > 0 ? (displayed - m_overlayDisplayed) / sec : 0;
+    double decodeMs = decoded > m_overlayDecoded ? (decodeNs - m_overlayDecodeNs) / 1e6 / (decoded - m_overlayDecoded) : 0;
+
+    m_overlayText = QString("%1 fps  decode %2 ms  dropped %3  repeated %4  queue %5  driver %6  %7 MB/s")
+            .arg(fps, 0, 'f', 1).arg(decodeMs, 0, 'f', 2)
+            .arg(Metrics::Get(METRIC_FRAMES_DROPPED)).arg(Metrics::Get(METRIC_FRAMES_REPEATED))
+            .arg(Metrics::Get(METRIC_DISPLAY_QUEUE)).arg(Metrics::Get(METRIC_DRIVER_QUEUED))
+            .arg(Metrics::Get(METRIC_BYTES_PER_SEC) / 1e6, 0, 'f', 2);
+
+    m_overlayDisplayed = displayed;
+    m_overlayDecoded = decoded;
+    m_overlayDecodeNs = decodeNs;
+}
+
+void MainWindow::drawOverlay(QPixmap& pixmap)
+{
+    if (m_overlayText.isEmpty() || !m_overlayTimer.isValid() || m_overlayTimer.elapsed() >= 1000)
+        updateOverlayText();
+
+    QPainter painter(&pixmap);
+    QRect box = painter.fontMetrics().boundingRect(m_overlayText).adjusted(-4, -2, 4, 2);
+    box.moveTopLeft(QPoint(8, 8));
+    painter.fillRect(box, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(box, Qt::AlignCenter, m_overlayText);
+}
+
 void MainWindow::printError(const QString &str)
 {
     ui->lblMsg->setText(str);
 }
 
+void MainWindow::reportFrozen(int frames)
+{
+    // CKim - Image on screen is no longer live
+    ui->lblMsg->setText(QString("FROZEN : camera repeated the same frame %1 times").arg(frames));
+}
+
+void MainWindow::reportResumed()
+{
+    ui->lblMsg->setText("Live");
+}
+
 void MainWindow::recoverfromTimeout()
 {
     m_Video->ClearTimeoutError();
+    Metrics::Add(METRIC_RECOVERIES);
     ui->lblMsg->setText("Sparta!!!!");
     //sleep(1);
     usleep(500000);
@@ -2,6 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QElapsedTimer>
 
 #include "usbvideo.h"
 
@@ -14,21 +15,47 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    explicit MainWindow(const QString& device = "/dev/video0", QWidget *parent = nullptr);
     ~MainWindow();
 
+    void SetRealtimeConfig(const rt_config& cfg)    {   m_Video->SetRealtimeConfig(cfg);    }
+    void SetDenoiseStrength(int strength);
+    void SetFrozenThreshold(int frames)     {   m_Video->SetFrozenThreshold(frames);    }
+    void SetOverlay(bool on);
+    void SetSnapshotConfig(const QString& dir, int burst)   {   m_snapshotDir = dir;    m_snapshotBurst = burst;    }
+
 private slots:
     void on_btnInit_clicked();
     void on_btnStart_clicked();
     void updatePixmap(const QImage &image);
     void printError(const QString& str);
     void recoverfromTimeout();
+    void reportFrozen(int frames);
+    void reportResumed();
     void on_btnStop_clicked();
+    void on_chkDenoise_toggled(bool checked);
+    void on_chkOverlay_toggled(bool checked);
+    void on_btnSnapshot_clicked();
+    void reportSnapshot(const QString& path);
 
 private:
     Ui::MainWindow *ui;
 
     UsbVideo* m_Video;
+    int m_denoiseStrength;
+    QString m_snapshotDir;
+    int m_snapshotBurst;
+
+    // CKim - Statistics overlay, text is rebuilt once a second from the metrics
+    void updateOverlayText();
+    void drawOverlay(QPixmap& pixmap);
+
+    bool            m_overlay;
+    QString         m_overlayText;
+    QElapsedTimer   m_overlayTimer;
+    int64_t         m_overlayDisplayed;
+    int64_t         m_overlayDecodeNs;
+    int64_t         m_overlayDecoded;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,78 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <atomic>
+
+enum metric_type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+};
+
+struct metric_desc {
+        const char* name;
+        const char* help;
+        metric_type type;
+        double      scale;          // exported value = stored value * scale
+};
+
+// CKim - Same order as enum metric_id. Times are kept in ns and exported in seconds.
+static const metric_desc s_desc[METRIC_COUNT] = {
+    { "endoscope_frames_dequeued_total",    "Frames dequeued from the capture source.",             METRIC_COUNTER, 1 },
+    { "endoscope_frames_decoded_total",     "Frames decoded and sent to the display.",              METRIC_COUNTER, 1 },
+    { "endoscope_frames_displayed_total",   "Frames painted on screen.",                            METRIC_COUNTER, 1 },
+    { "endoscope_frames_dropped_total",     "Frames lost according to the driver sequence number.", METRIC_COUNTER, 1 },
+    { "endoscope_frames_repeated_total",    "Identical frames skipped without decode.",             METRIC_COUNTER, 1 },
+    { "endoscope_decode_errors_total",      "Frames that failed to decode.",                        METRIC_COUNTER, 1 },
+    { "endoscope_decode_seconds_total",     "Time spent decoding, converting and denoising.",       METRIC_COUNTER, 1e-9 },
+    { "endoscope_decode_seconds_last",      "Decode time of the most recent frame.",                METRIC_GAUGE,   1e-9 },
+    { "endoscope_display_queue_depth",      "Frames sent to the display and not painted yet.",      METRIC_GAUGE,   1 },
+    { "endoscope_driver_buffers_queued",    "Capture buffers queued to the driver. At 0 the camera drops frames.", METRIC_GAUGE, 1 },
+    { "endoscope_driver_buffers_held",      "Capture buffers dequeued and not yet returned to the driver.", METRIC_GAUGE, 1 },
+    { "endoscope_recoveries_total",         "Capture restarts after a timeout.",                    METRIC_COUNTER, 1 },
+    { "endoscope_capture_bytes_total",      "Payload bytes received from the camera.",              METRIC_COUNTER, 1 },
+    { "endoscope_capture_bytes_per_second", "Payload rate over the last second.",                   METRIC_GAUGE,   1 },
+};
+
+// CKim - One cache line per metric, so the capture and GUI threads never write the same line
+struct alignas(64) metric_slot {
+        std::atomic<int64_t> value;
+};
+
+static metric_slot s_slots[METRIC_COUNT];
+
+void Metrics::Add(metric_id id, int64_t value)
+{
+    s_slots[id].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Metrics::Set(metric_id id, int64_t value)
+{
+    s_slots[id].value.store(value, std::memory_order_relaxed);
+}
+
+int64_t Metrics::Get(metric_id id)
+{
+    return s_slots[id].value.load(std::memory_order_relaxed);
+}
+
+QByteArray Metrics::FormatPrometheus()
+{
+    QByteArray out;
+    out.reserve(METRIC_COUNT * 160);
+
+    char line[256];
+    for (int i = 0; i < METRIC_COUNT; ++i)
+    {
+        const metric_desc& d = s_desc[i];
+        int64_t v = Get((metric_id)i);
+
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", d.name, d.help,
+                 d.name, d.type == METRIC_COUNTER ? "counter" : "gauge");
+        out.append(line);
+
+        if (d.scale == 1)   {   snprintf(line, sizeof(line), "%s %lld\n", d.name, (long long)v);     }
+        else                {   snprintf(line, sizeof(line), "%s %.9g\n", d.name, v * d.scale);     }
+        out.append(line);
+    }
+    return out;
+}
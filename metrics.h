@@ -0,0 +1,44 @@
+// --------------------------------------------------------------- //
+// CKim - Runtime statistics of the video pipeline.
+// A fixed table of counters and gauges, one atomic per metric on its own
+// cache line. Capture and GUI threads update them with relaxed atomic adds,
+// no locks, and readers only ever see a slightly stale value.
+// Exported as Prometheus text by MetricsServer and drawn by the overlay.
+// --------------------------------------------------------------- //
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include <QByteArray>
+
+enum metric_id {
+        METRIC_FRAMES_DEQUEUED,         // buffers dequeued from the driver or the frame file
+        METRIC_FRAMES_DECODED,          // frames decoded / converted and sent to the GUI
+        METRIC_FRAMES_DISPLAYED,        // frames painted by the GUI
+        METRIC_FRAMES_DROPPED,          // gaps in the driver sequence number
+        METRIC_FRAMES_REPEATED,         // identical frames skipped
+        METRIC_DECODE_ERRORS,
+        METRIC_DECODE_NS_TOTAL,         // time spent in decode, conversion and denoise
+        METRIC_DECODE_NS_LAST,
+        METRIC_DISPLAY_QUEUE,           // frames sent to the GUI and not painted yet
+        METRIC_DRIVER_QUEUED,           // V4L2 buffers queued to the driver, empty or filling
+        METRIC_DRIVER_HELD,             // V4L2 buffers dequeued and not yet returned by the app
+        METRIC_RECOVERIES,              // restarts after a select timeout
+        METRIC_BYTES_TOTAL,             // payload bytes received from the camera
+        METRIC_BYTES_PER_SEC,           // payload rate over the last second
+        METRIC_COUNT
+};
+
+namespace Metrics
+{
+    void Add(metric_id id, int64_t value = 1);
+    void Set(metric_id id, int64_t value);
+    int64_t Get(metric_id id);
+
+    // CKim - All metrics in the Prometheus text exposition format
+    QByteArray FormatPrometheus();
+}
+
+#endif // METRICS_H
@@ -0,0 +1,57 @@
+#include "metricsserver.h"
+#include "metrics.h"
+
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QVariant>
+
+MetricsServer::MetricsServer(QObject* parent) : QObject(parent)
+{
+    connect(&m_server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+}
+
+int MetricsServer::Start(quint16 port)
+{
+    // CKim - Loopback only, the statistics are not meant to leave the device unless tunnelled
+    if (!m_server.listen(QHostAddress::LocalHost, port))
+    {
+        m_errStr = QString("Metrics server cannot listen on port %1 : %2").arg(port).arg(m_server.errorString());
+        return 0;
+    }
+    m_msgStr = QString("Metrics on http://127.0.0.1:%1/metrics").arg(port);
+    return 1;
+}
+
+void MetricsServer::acceptConnection()
+{
+    while (m_server.hasPendingConnections())
+    {
+        QTcpSocket* socket = m_server.nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(serveRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MetricsServer::serveRequest()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket)    {   return;     }
+
+    // CKim - Wait for the end of the request header, the request itself is not parsed
+    QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+    if (!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+    {
+        if (request.size() > 8192)  {   socket->abort();    return;     }
+        socket->setProperty("request", request);
+        return;
+    }
+
+    QByteArray body = Metrics::FormatPrometheus();
+    QByteArray header = "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Connection: close\r\n"
+                        "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+    socket->write(header);
+    socket->write(body);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,37 @@
+// --------------------------------------------------------------- //
+// CKim - Minimal HTTP endpoint serving Metrics::FormatPrometheus() on the
+// loopback interface. Any request gets the metrics, so it can be scraped by
+// Prometheus or read with 'curl localhost:<port>/metrics'.
+// Runs in the GUI thread event loop and only reads the atomic counters.
+// --------------------------------------------------------------- //
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QString>
+
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    MetricsServer(QObject* parent = 0);
+
+    int Start(quint16 port);
+
+    const QString&  GetErrStr()     {   return m_errStr;    }
+    const QString&  GetMsgStr()     {   return m_msgStr;    }
+
+private slots:
+    void acceptConnection();
+    void serveRequest();
+
+private:
+    QTcpServer  m_server;
+    QString     m_errStr;
+    QString     m_msgStr;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,228 @@
+#include "snapshotwriter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <QBuffer>
+#include <QFileInfo>
+
+// CKim - Standard Huffman tables of ITU-T T.81 Annex K.3 (DC and AC, luminance and
+// chrominance) as one DHT segment. Many UVC cameras leave them out of every frame (the
+// AVI1 convention), which decoders accept but image viewers and libraries may not.
+static const unsigned char std_dht_segment[] = {
+    0xff, 0xc4, 0x01, 0xa2, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+    0x0b, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00,
+    0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51,
+    0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52,
+    0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47,
+    0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6,
+    0xf7, 0xf8, 0xf9, 0xfa, 0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+    0x0b, 0x11, 0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01,
+    0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07,
+    0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33,
+    0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19,
+    0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46,
+    0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66,
+    0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85,
+    0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+    0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6,
+    0xf7, 0xf8, 0xf9, 0xfa
+};
+
+// CKim - Offset of the SOS marker if no DHT comes before it, i.e. where the tables go.
+// -1 if the tables are present or the markers cannot be followed, then the data is kept as is.
+static int findMissingDht(const unsigned char* p, int size)
+{
+    if (size < 4 || p[0] != 0xff || p[1] != 0xd8)   {   return -1;  }
+
+    int i = 2;
+    while (i + 4 <= size)
+    {
+        if (p[i] != 0xff)   {   return -1;  }
+        unsigned char marker = p[i + 1];
+        if (marker == 0xff)                 {   i++;        continue;   }   // fill byte
+        if (marker == 0xc4)                 {   return -1;  }
+        if (marker == 0xda)                 {   return i;   }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))   {   i += 2;     continue;   }
+        i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+    }
+    return -1;
+}
+
+double MeasureSharpness(const QImage& image)
+{
+    if (image.depth() != 32 || image.width() < 2)   {   return 0;   }
+
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    for (int row = 0; row < image.height(); row += 4)
+    {
+        const uint32_t* p = (const uint32_t*)image.constScanLine(row);
+        for (int x = 1; x < image.width(); ++x)
+        {
+            int d = (int)((p[x] >> 8) & 0xff) - (int)((p[x - 1] >> 8) & 0xff);
+            sum += d * d;
+        }
+        count += image.width() - 1;
+    }
+    return count ? (double)sum / count : 0;
+}
+
+SnapshotWriter::SnapshotWriter(QObject* parent) : QThread(parent)
+{
+    m_stop = false;
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    Stop();
+}
+
+int SnapshotWriter::Enqueue(const snapshot_job& job)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_queue.size() >= SNAPSHOT_QUEUE_MAX)   {   return 0;   }
+    m_queue.append(job);
+    m_cond.wakeOne();
+    return 1;
+}
+
+void SnapshotWriter::Stop()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_cond.wakeOne();
+    }
+    wait();
+
+    QMutexLocker lock(&m_mutex);
+    m_stop = false;
+}
+
+void SnapshotWriter::run()
+{
+    for (;;)
+    {
+        snapshot_job job;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.isEmpty() && !m_stop)    {   m_cond.wait(&m_mutex);  }
+            if (m_queue.isEmpty())  {   return;     }
+            job = m_queue.takeFirst();
+        }
+
+        if (writeJob(job))  {   emit saved(job.path);   }
+        else                {   emit failed(m_errStr);  }
+    }
+}
+
+int SnapshotWriter::writeJob(const snapshot_job& job)
+{
+    // CKim - Raw formats are encoded here rather than in the capture thread, and MJPEG
+    // frames without Huffman tables are completed here
+    QByteArray encoded;
+    const QByteArray* data = &job.jpeg;
+    if (job.jpeg.isEmpty())
+    {
+        QBuffer device(&encoded);
+        device.open(QIODevice::WriteOnly);
+        if (!job.image.save(&device, "JPG", SNAPSHOT_JPEG_QUALITY))
+        {
+            m_errStr = QString("Snapshot %1 : failed to encode").arg(job.path);
+            return 0;
+        }
+        data = &encoded;
+    }
+    else
+    {
+        int sos = findMissingDht((const unsigned char*)job.jpeg.constData(), job.jpeg.size());
+        if (sos >= 0)
+        {
+            encoded.reserve(job.jpeg.size() + (int)sizeof(std_dht_segment));
+            encoded.append(job.jpeg.constData(), sos);
+            encoded.append((const char*)std_dht_segment, sizeof(std_dht_segment));
+            encoded.append(job.jpeg.constData() + sos, job.jpeg.size() - sos);
+            data = &encoded;
+        }
+    }
+
+    // CKim - Write to a temporary name and rename, so a crash never leaves a truncated image
+    QByteArray path = job.path.toLocal8Bit();
+    QByteArray tmpPath = path + ".part";
+    FILE* fp = fopen(tmpPath.constData(), "wb");
+    if (!fp)
+    {
+        m_errStr.sprintf("Snapshot '%s' : %d, %s", path.constData(), errno, strerror(errno));
+        return 0;
+    }
+
+    bool ok = (int)fwrite(data->constData(), 1, data->size(), fp) == data->size();
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (!ok)    {   m_errStr.sprintf("Snapshot '%s' : %d, %s", path.constData(), errno, strerror(errno));  }
+    fclose(fp);
+
+    if (ok && rename(tmpPath.constData(), path.constData()) != 0)
+    {
+        m_errStr.sprintf("Snapshot '%s' : %d, %s", path.constData(), errno, strerror(errno));
+        ok = false;
+    }
+    if (!ok)
+    {
+        unlink(tmpPath.constData());
+        return 0;
+    }
+
+    return writeMetadata(job, job.path);
+}
+
+int SnapshotWriter::writeMetadata(const snapshot_job& job, const QString& path)
+{
+    // CKim - snapshot.jpg gets snapshot.json next to it
+    QString metaPath = path;
+    if (metaPath.endsWith(".jpg"))  {   metaPath.chop(4);   }
+    metaPath += ".json";
+
+    struct tm local;
+    time_t sec = job.wallTime.tv_sec;
+    localtime_r(&sec, &local);
+    char wall[64];
+    strftime(wall, sizeof(wall), "%Y-%m-%dT%H:%M:%S", &local);
+
+    FILE* fp = fopen(metaPath.toLocal8Bit().constData(), "w");
+    if (!fp)
+    {
+        m_errStr.sprintf("Snapshot metadata '%s' : %d, %s", metaPath.toLocal8Bit().constData(), errno, strerror(errno));
+        return 0;
+    }
+    fprintf(fp, "{\n"
+                "  \"image\": \"%s\",\n"
+                "  \"captured\": \"%s.%03ld\",\n"
+                "  \"device_timestamp_us\": %lld,\n"
+                "  \"sequence\": %u,\n"
+                "  \"width\": %d,\n"
+                "  \"height\": %d,\n"
+                "  \"compressed\": %s,\n"
+                "  \"sharpness\": %.2f,\n"
+                "  \"burst\": %d\n"
+                "}\n",
+            QFileInfo(path).fileName().toLocal8Bit().constData(), wall, job.wallTime.tv_nsec / 1000000,
+            (long long)job.deviceTime.tv_sec * 1000000LL + job.deviceTime.tv_usec,
+            job.sequence, job.width, job.height, job.jpeg.isEmpty() ? "false" : "true",
+            job.sharpness, job.burst);
+    fclose(fp);
+    return 1;
+}
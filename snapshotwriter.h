@@ -0,0 +1,77 @@
+// --------------------------------------------------------------- //
+// CKim - Saves still images off the capture thread.
+// UsbVideo hands over the compressed MJPEG payload (or a copy of the
+// converted image for raw formats) and returns immediately, this thread
+// writes the file and a .json sidecar with the capture metadata.
+// --------------------------------------------------------------- //
+
+#ifndef SNAPSHOTWRITER_H
+#define SNAPSHOTWRITER_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <QByteArray>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+// CKim - Snapshots waiting for the disk. Enqueue() refuses more instead of blocking.
+#define SNAPSHOT_QUEUE_MAX  4
+
+// CKim - JPEG quality used when a raw frame has to be encoded
+#define SNAPSHOT_JPEG_QUALITY   95
+
+struct snapshot_job {
+        QString         path;
+        QByteArray      jpeg;           // compressed payload as received (DHT added on write), empty for raw formats
+        QImage          image;          // converted frame, only used when jpeg is empty
+        struct timeval  deviceTime;     // driver timestamp of the buffer
+        struct timespec wallTime;       // CLOCK_REALTIME when the frame was picked
+        uint32_t        sequence;       // driver sequence number
+        int             width;
+        int             height;
+        double          sharpness;      // mean squared gradient, see MeasureSharpness()
+        int             burst;          // frames compared to pick this one
+};
+
+// CKim - Focus measure of a 32 bit image, mean squared horizontal gradient of the
+// green channel on every 4th row. Only meaningful to compare frames of one stream.
+double MeasureSharpness(const QImage& image);
+
+class SnapshotWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    SnapshotWriter(QObject* parent = 0);
+    ~SnapshotWriter();
+
+    // CKim - Queue a snapshot for writing, returns 0 if the queue is full
+    int Enqueue(const snapshot_job& job);
+
+    // CKim - Write what is queued and end the thread
+    void Stop();
+
+signals:
+    void saved(const QString& path);
+    void failed(const QString& str);
+
+protected:
+    void run() override;
+
+private:
+    int writeJob(const snapshot_job& job);
+    int writeMetadata(const snapshot_job& job, const QString& path);
+
+    QMutex              m_mutex;
+    QWaitCondition      m_cond;
+    QList<snapshot_job> m_queue;
+    bool                m_stop;
+    QString             m_errStr;
+};
+
+#endif // SNAPSHOTWRITER_H
@@ -0,0 +1,292 @@
+#include "temporaldenoise.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <QThread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DENOISE_NEON
+#endif
+
+// --------------------------------------------------------------- //
+// CKim - Kernels. All work on bytes of packed RGB32, the alpha byte is
+// 0xff in both frame and history so it never contributes.
+// Blend : out = hist + round((cur - hist) * alpha / 128), alpha in Q7
+// --------------------------------------------------------------- //
+
+uint32_t DenoiseSadRowScalar(const uint8_t* cur, const uint8_t* hist, int bytes)
+{
+    uint32_t sad = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        int d = cur[i] - hist[i];
+        sad += d < 0 ? -d : d;
+    }
+    return sad;
+}
+
+void DenoiseBlendRowScalar(uint8_t* cur, uint8_t* hist, int bytes, int alpha)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        int d = cur[i] - hist[i];
+        int o = hist[i] + ((d * alpha + 64) >> 7);
+        cur[i] = hist[i] = (uint8_t)(o < 0 ? 0 : (o > 255 ? 255 : o));
+    }
+}
+
+uint32_t DenoiseSadRow(const uint8_t* cur, const uint8_t* hist, int bytes)
+{
+    uint32_t sad = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i*)(cur + i));
+        __m128i h = _mm_loadu_si128((const __m128i*)(hist + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(c, h));
+    }
+    sad = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(DENOISE_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (; i + 16 <= bytes; i += 16)
+    {
+        uint8x16_t d = vabdq_u8(vld1q_u8(cur + i), vld1q_u8(hist + i));
+        acc = vpadalq_u8(acc, d);
+    }
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(acc));
+    sad = (uint32_t)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#endif
+
+    return sad + DenoiseSadRowScalar(cur + i, hist + i, bytes - i);
+}
+
+void DenoiseBlendRow(uint8_t* cur, uint8_t* hist, int bytes, int alpha)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i va = _mm_set1_epi16((short)alpha);
+    const __m128i round = _mm_set1_epi16(64);
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i*)(cur + i));
+        __m128i h = _mm_loadu_si128((const __m128i*)(hist + i));
+        __m128i hlo = _mm_unpacklo_epi8(h, zero);
+        __m128i hhi = _mm_unpackhi_epi8(h, zero);
+
+        // CKim - |cur - hist| * 128 fits in 16 bits, so plain mullo is enough
+        __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(c, zero), hlo);
+        __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(c, zero), hhi);
+        dlo = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(dlo, va), round), 7);
+        dhi = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(dhi, va), round), 7);
+
+        __m128i o = _mm_packus_epi16(_mm_add_epi16(hlo, dlo), _mm_add_epi16(hhi, dhi));
+        _mm_storeu_si128((__m128i*)(cur + i), o);
+        _mm_storeu_si128((__m128i*)(hist + i), o);
+    }
+#elif defined(DENOISE_NEON)
+    const int16x8_t va = vdupq_n_s16((int16_t)alpha);
+    for (; i + 16 <= bytes; i += 16)
+    {
+        uint8x16_t c = vld1q_u8(cur + i);
+        uint8x16_t h = vld1q_u8(hist + i);
+
+        int16x8_t dlo = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(c), vget_low_u8(h)));
+        int16x8_t dhi = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(c), vget_high_u8(h)));
+        dlo = vrshrq_n_s16(vmulq_s16(dlo, va), 7);
+        dhi = vrshrq_n_s16(vmulq_s16(dhi, va), 7);
+
+        int16x8_t olo = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(h))), dlo);
+        int16x8_t ohi = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(h))), dhi);
+        uint8x16_t o = vcombine_u8(vqmovun_s16(olo), vqmovun_s16(ohi));
+        vst1q_u8(cur + i, o);
+        vst1q_u8(hist + i, o);
+    }
+#endif
+
+    DenoiseBlendRowScalar(cur + i, hist + i, bytes - i, alpha);
+}
+
+// --------------------------------------------------------------- //
+
+TemporalDenoiser::TemporalDenoiser()
+{
+    m_history = NULL;
+    m_histStride = 0;
+    m_width = 0;
+    m_height = 0;
+    m_valid = false;
+    m_frame = NULL;
+    m_frameStride = 0;
+
+    // CKim - Calling thread takes one band, the pool the rest. Keep the pool threads
+    // alive, otherwise they expire between frames and are recreated.
+    m_numBands = QThread::idealThreadCount();
+    if (m_numBands < 1)                 {   m_numBands = 1;                 }
+    if (m_numBands > DENOISE_MAX_BANDS) {   m_numBands = DENOISE_MAX_BANDS; }
+    m_pool.setMaxThreadCount(m_numBands > 1 ? m_numBands - 1 : 1);
+    m_pool.setExpiryTimeout(-1);
+    for (int i = 0; i < DENOISE_MAX_BANDS; ++i)     {   m_bands[i].owner = this;    }
+
+    m_policy = SCHED_OTHER;
+    m_priority = 0;
+    CPU_ZERO(&m_cpus);
+    m_setCpus = false;
+    m_singleCpu = false;
+    m_configGen = 0;
+
+    SetStrength(50);
+}
+
+TemporalDenoiser::~TemporalDenoiser()
+{
+    m_pool.waitForDone();
+    free(m_history);
+}
+
+void TemporalDenoiser::SetStrength(int strength)
+{
+    if (strength < 0)       {   strength = 0;   }
+    if (strength > 100)     {   strength = 100; }
+    m_strength = strength;
+
+    // CKim - Strongest setting keeps 1/8 of the new frame in static blocks. Motion
+    // thresholds grow with strength since stronger filtering is for noisier gain.
+    m_minAlpha = 128 - strength * 112 / 100;
+    m_motionLow = 16 * (2 + strength / 12);
+    m_motionHigh = m_motionLow + 16 * (6 + strength / 8);
+}
+
+void TemporalDenoiser::SetThreadConfig(int policy, int priority, const cpu_set_t* cpus)
+{
+    m_policy = policy;
+    m_priority = priority;
+    m_setCpus = cpus != NULL;
+    if (cpus)   {   m_cpus = *cpus;     }
+
+    // CKim - Workers confined to the caller's only CPU would just take turns with it
+    cpu_set_t own;
+    CPU_ZERO(&own);
+    m_singleCpu = cpus && CPU_COUNT(cpus) == 1 &&
+                  pthread_getaffinity_np(pthread_self(), sizeof(own), &own) == 0 && CPU_EQUAL(&own, cpus);
+    m_configGen++;
+}
+
+void TemporalDenoiser::applyThreadConfig()
+{
+    // CKim - Pool threads persist, so this normally runs once per thread. The config is
+    // written before QThreadPool::start(), whose lock orders it before this read.
+    static thread_local int appliedGen = 0;
+    if (appliedGen == m_configGen)  {   return;     }
+    appliedGen = m_configGen;
+
+    pthread_t self = pthread_self();
+    if (m_setCpus)  {   pthread_setaffinity_np(self, sizeof(m_cpus), &m_cpus);   }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = (m_policy == SCHED_FIFO || m_policy == SCHED_RR) ? m_priority : 0;
+    pthread_setschedparam(self, m_policy, &param);
+}
+
+bool TemporalDenoiser::allocate(int width, int height)
+{
+    free(m_history);
+    m_history = NULL;
+    m_width = m_height = 0;
+    m_valid = false;
+
+    int stride = (width * 4 + 15) & ~15;
+    void* p = NULL;
+    if (posix_memalign(&p, 16, (size_t)stride * height))    {   return false;   }
+
+    m_history = (uint8_t*)p;
+    m_histStride = stride;
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+void TemporalDenoiser::Process(uint8_t* frame, int stride, int width, int height)
+{
+    if (m_strength == 0)
+    {
+        m_valid = false;
+        return;
+    }
+
+    if (width != m_width || height != m_height || !m_history)
+    {
+        if (!allocate(width, height))   {   return;     }
+    }
+
+    // CKim - First frame only seeds the history
+    if (!m_valid)
+    {
+        for (int y = 0; y < height; ++y)
+            memcpy(m_history + y * m_histStride, frame + y * stride, width * 4);
+        m_valid = true;
+        return;
+    }
+
+    m_frame = frame;
+    m_frameStride = stride;
+
+    int blockRows = (height + DENOISE_BLOCK - 1) / DENOISE_BLOCK;
+    int bands = m_numBands < blockRows ? m_numBands : blockRows;
+    if (m_singleCpu)    {   bands = 1;  }
+    for (int i = 0; i < bands; ++i)
+    {
+        m_bands[i].firstBlockRow = blockRows * i / bands;
+        m_bands[i].lastBlockRow = blockRows * (i + 1) / bands;
+    }
+
+    for (int i = 1; i < bands; ++i)     {   m_pool.start(&m_bands[i]);  }
+    processBand(m_bands[0].firstBlockRow, m_bands[0].lastBlockRow);
+    if (bands > 1)      {   m_bandsDone.acquire(bands - 1);     }
+
+    m_frame = NULL;
+}
+
+int TemporalDenoiser::blockAlpha(uint32_t sad, int pixels)
+{
+    // CKim - Mean absolute difference per colour sample, scaled by 16
+    int mad = (int)((uint64_t)sad * 16 / (pixels * 3));
+    if (mad <= m_motionLow)     {   return m_minAlpha;  }
+    if (mad >= m_motionHigh)    {   return 128;         }
+    return m_minAlpha + (128 - m_minAlpha) * (mad - m_motionLow) / (m_motionHigh - m_motionLow);
+}
+
+void TemporalDenoiser::processBand(int firstBlockRow, int lastBlockRow)
+{
+    // CKim - Block by block, so the motion estimate and the blend that follows it
+    // touch the same few KB while they are still in L1
+    for (int br = firstBlockRow; br < lastBlockRow; ++br)
+    {
+        int y0 = br * DENOISE_BLOCK;
+        int y1 = y0 + DENOISE_BLOCK < m_height ? y0 + DENOISE_BLOCK : m_height;
+
+        for (int x0 = 0; x0 < m_width; x0 += DENOISE_BLOCK)
+        {
+            int w = x0 + DENOISE_BLOCK < m_width ? DENOISE_BLOCK : m_width - x0;
+            uint8_t* cur = m_frame + y0 * m_frameStride + x0 * 4;
+            uint8_t* hist = m_history + y0 * m_histStride + x0 * 4;
+
+            uint32_t sad = 0;
+            for (int y = 0; y < y1 - y0; ++y)
+                sad += DenoiseSadRow(cur + y * m_frameStride, hist + y * m_histStride, w * 4);
+
+            int alpha = blockAlpha(sad, w * (y1 - y0));
+            for (int y = 0; y < y1 - y0; ++y)
+                DenoiseBlendRow(cur + y * m_frameStride, hist + y * m_histStride, w * 4, alpha);
+        }
+    }
+}
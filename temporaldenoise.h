@@ -0,0 +1,112 @@
+// --------------------------------------------------------------- //
+// CKim - Motion adaptive temporal noise reduction for RGB32 frames.
+// Each pixel is blended with a running history frame. The blend weight is
+// chosen per 16x16 block from the mean absolute difference between the
+// new frame and the history, so static tissue is averaged over many frames
+// while moving instruments stay sharp. Fixed point, SSE2 / NEON with a
+// scalar fallback, split into row bands over a small thread pool.
+// Filters in place, so it adds processing time but no frame of delay.
+// --------------------------------------------------------------- //
+
+#ifndef TEMPORALDENOISE_H
+#define TEMPORALDENOISE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#define DENOISE_BLOCK       16      // block size for the motion estimate, pixels
+#define DENOISE_MAX_BANDS   4       // max number of row bands processed in parallel
+
+// CKim - Row kernels of Process() on bytes of packed RGB32. Blend writes the result to
+// both cur and hist, alpha in Q7 (0..128). The SSE2 / NEON builds of DenoiseSadRow() and
+// DenoiseBlendRow() must match the Scalar versions bit for bit, see tests/denoisekernels.
+uint32_t DenoiseSadRow(const uint8_t* cur, const uint8_t* hist, int bytes);
+void     DenoiseBlendRow(uint8_t* cur, uint8_t* hist, int bytes, int alpha);
+uint32_t DenoiseSadRowScalar(const uint8_t* cur, const uint8_t* hist, int bytes);
+void     DenoiseBlendRowScalar(uint8_t* cur, uint8_t* hist, int bytes, int alpha);
+
+class TemporalDenoiser
+{
+public:
+    TemporalDenoiser();
+    ~TemporalDenoiser();
+
+    // CKim - 0 passes frames through, 100 averages static areas the most
+    void SetStrength(int strength);
+    int  GetStrength()      {   return m_strength;  }
+
+    // CKim - Forget the history, e.g. after the stream restarted
+    void Reset()            {   m_valid = false;    }
+
+    // CKim - Scheduling of the pool threads. The policy is normally copied from the calling
+    // thread so that a real-time caller never waits in Process() on lower priority workers.
+    // cpus NULL leaves the affinity alone, i.e. inherited from the thread that created them.
+    // Call from the thread that runs Process(). If cpus is just the one CPU that thread is
+    // pinned to, all bands run on the caller.
+    void SetThreadConfig(int policy, int priority, const cpu_set_t* cpus);
+
+    // CKim - Filter one frame in place. Format must be QImage::Format_RGB32.
+    void Process(uint8_t* frame, int stride, int width, int height);
+
+private:
+    // CKim - One row band, run on the pool or on the calling thread
+    class Band : public QRunnable
+    {
+    public:
+        Band() : owner(0), firstBlockRow(0), lastBlockRow(0) {   setAutoDelete(false);   }
+        void run() override
+        {
+            owner->applyThreadConfig();
+            owner->processBand(firstBlockRow, lastBlockRow);
+            owner->m_bandsDone.release();
+        }
+
+        TemporalDenoiser*   owner;
+        int                 firstBlockRow;
+        int                 lastBlockRow;
+    };
+
+    bool allocate(int width, int height);
+    void processBand(int firstBlockRow, int lastBlockRow);
+    void applyThreadConfig();
+    int  blockAlpha(uint32_t sad, int pixels);
+
+    int         m_strength;
+    int         m_minAlpha;         // blend weight of a static block, Q7 (128 = new frame only)
+    int         m_motionLow;        // mean abs difference (x16) still treated as noise
+    int         m_motionHigh;       // mean abs difference (x16) treated as full motion
+
+    // CKim - History is packed RGB32 like the frame, rows padded to 16 bytes
+    uint8_t*    m_history;
+    int         m_histStride;
+    int         m_width;
+    int         m_height;
+    bool        m_valid;
+
+    // CKim - Frame being processed, only valid inside Process()
+    uint8_t*    m_frame;
+    int         m_frameStride;
+
+    // CKim - Pool bands release one each when finished. QThreadPool::waitForDone() is not used
+    // per frame, it also stops and joins the pool threads.
+    QThreadPool m_pool;
+    QSemaphore  m_bandsDone;
+    Band        m_bands[DENOISE_MAX_BANDS];
+    int         m_numBands;
+
+    // CKim - Written by the calling thread between frames, applied by each pool thread
+    // the first time it runs a band after a change (see applyThreadConfig)
+    int         m_policy;
+    int         m_priority;
+    cpu_set_t   m_cpus;
+    bool        m_setCpus;
+    bool        m_singleCpu;
+    int         m_configGen;
+};
+
+#endif // TEMPORALDENOISE_H
@@ -0,0 +1,165 @@
+// --------------------------------------------------------------- //
+// CKim - Steady state allocation test for the capture loop.
+// Replays a few thousand frames through UsbVideo with the file-fed source
+// and reads the per-frame allocation statistics (see alloctracker.h).
+// Allocations are counted at the malloc layer, so those made inside Qt and
+// libjpeg on the capture thread are included. YUYV, with and without the
+// temporal denoiser, must not allocate at all after the warm-up. MJPEG decoding
+// goes through Qt's JPEG handler, which QImageReader recreates for every frame,
+// so it is held to a per-frame ceiling instead.
+// Exits non-zero if any check fails.
+// --------------------------------------------------------------- //
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QVector>
+
+#include "usbvideo.h"
+
+#define TEST_FRAMES     3000
+#define TEST_WIDTH      640
+#define TEST_HEIGHT     480
+
+// CKim - Distinct frames in the corpus, so that no MJPEG frame is skipped as repeated
+#define TEST_CORPUS     8
+
+// CKim - Per-frame limits for MJPEG. These are not measured figures, they are set
+// to what the pipeline must never exceed. The handler and libjpeg's pools and row
+// buffers are recreated for every frame, but any full frame buffer, be it the RGB32
+// output (4 bytes per pixel) or an RGB888 intermediate (3), is above the byte limit.
+// Allocating per row, or per MCU, exceeds the count limit.
+#define MJPEG_MAX_ALLOCS_PER_FRAME  (TEST_HEIGHT / 2)
+#define MJPEG_MAX_BYTES_PER_FRAME   (TEST_WIDTH * TEST_HEIGHT)
+
+// CKim - Strength for the denoised YUYV pass, the denoiser must work from its own
+// history buffer and a pool that is kept alive between frames
+#define TEST_DENOISE_STRENGTH       50
+
+// CKim - Holds the last image like the GUI holds its pixmap, so the pool has to skip a
+// busy slot. Connected directly, a queued connection would allocate an event per frame.
+class HoldingSink : public QObject
+{
+    Q_OBJECT
+public slots:
+    void onImage(const QImage& image)   {   m_held = image;     }
+private:
+    QImage  m_held;
+};
+
+static QImage makeFrame(int seed)
+{
+    QImage img(TEST_WIDTH, TEST_HEIGHT, QImage::Format_RGB32);
+    for (int y = 0; y < TEST_HEIGHT; ++y)
+    {
+        QRgb* line = (QRgb*)img.scanLine(y);
+        for (int x = 0; x < TEST_WIDTH; ++x)
+            line[x] = qRgb((x + seed * 13) & 0xff, (y * 2 + seed * 7) & 0xff, ((x ^ y) + seed) & 0xff);
+    }
+    return img;
+}
+
+static QByteArray toYUYV(const QImage& img)
+{
+    QByteArray out(TEST_WIDTH * TEST_HEIGHT * 2, 0);
+    uchar* d = (uchar*)out.data();
+    for (int y = 0; y < TEST_HEIGHT; ++y)
+    {
+        const QRgb* line = (const QRgb*)img.constScanLine(y);
+        for (int x = 0; x < TEST_WIDTH; x += 2, d += 4)
+        {
+            d[0] = qGray(line[x]);  d[1] = 128;     d[2] = qGray(line[x + 1]);  d[3] = 128;
+        }
+    }
+    return out;
+}
+
+// CKim - Same layout as UsbVideo::OpenFrameFile() : [4 byte LE length][payload] ...
+static bool writeFrameFile(const QString& path, const QVector<QByteArray>& frames)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate))    {   return false;   }
+    for (int i = 0; i < frames.size(); ++i)
+    {
+        quint32 len = frames[i].size();
+        char hdr[4] = { (char)(len & 0xff), (char)((len >> 8) & 0xff), (char)((len >> 16) & 0xff), (char)((len >> 24) & 0xff) };
+        f.write(hdr, 4);
+        f.write(frames[i]);
+    }
+    return true;
+}
+
+static int runFormat(const QString& path, unsigned int pixelformat, const char* name,
+                     int denoise, uint64_t maxAllocs, uint64_t maxBytes)
+{
+    UsbVideo video;
+    if (!video.OpenFrameFile(path.toLocal8Bit().constData(), TEST_WIDTH, TEST_HEIGHT,
+                             pixelformat, 0, TEST_FRAMES) ||
+        !video.InitializeDevice(IO_METHOD_FILE))
+    {
+        printf("FAIL %s : %s\n", name, qPrintable(video.GetErrStr()));
+        return 0;
+    }
+
+    video.SetDenoiseStrength(denoise);
+
+    HoldingSink sink;
+    QObject::connect(&video, SIGNAL(renderedImage(QImage)), &sink, SLOT(onImage(QImage)), Qt::DirectConnection);
+
+    video.StartCapture();
+    video.wait();
+    video.StopCapture();
+
+    const alloc_stats& s = video.GetAllocStats();
+    bool ok = s.frames == TEST_FRAMES && s.maxAllocs <= maxAllocs && s.maxBytes <= maxBytes &&
+              (maxAllocs > 0 || s.allocFrames == 0);
+    printf("%s %s : %lu frames, %lu allocating, worst frame %llu allocs / %llu bytes, limit %llu / %llu\n",
+           ok ? "PASS" : "FAIL", name, s.frames, s.allocFrames,
+           (unsigned long long)s.maxAllocs, (unsigned long long)s.maxBytes,
+           (unsigned long long)maxAllocs, (unsigned long long)maxBytes);
+    video.CloseDevice();
+    return ok ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (!AllocTracker::isEnabled())
+    {
+        printf("FAIL : built without USBVIDEO_ALLOC_TRACKING\n");
+        return 1;
+    }
+
+    QVector<QByteArray> mjpeg, yuyv;
+    for (int i = 0; i < TEST_CORPUS; ++i)
+    {
+        QImage img = makeFrame(i);
+        QByteArray jpg;
+        QBuffer buf(&jpg);
+        buf.open(QIODevice::WriteOnly);
+        img.save(&buf, "JPG", 85);
+        mjpeg.append(jpg);
+        yuyv.append(toYUYV(img));
+    }
+
+    QTemporaryDir dir;
+    QString yuyvPath = QDir(dir.path()).filePath("yuyv.frames");
+    QString mjpegPath = QDir(dir.path()).filePath("mjpeg.frames");
+    if (!writeFrameFile(yuyvPath, yuyv) || !writeFrameFile(mjpegPath, mjpeg))
+    {
+        printf("FAIL : cannot write frame files in %s\n", qPrintable(dir.path()));
+        return 1;
+    }
+
+    int passed = 0;
+    passed += runFormat(yuyvPath, V4L2_PIX_FMT_YUYV, "YUYV", 0, 0, 0);
+    passed += runFormat(yuyvPath, V4L2_PIX_FMT_YUYV, "YUYV+denoise", TEST_DENOISE_STRENGTH, 0, 0);
+    passed += runFormat(mjpegPath, V4L2_PIX_FMT_MJPEG, "MJPEG", 0, MJPEG_MAX_ALLOCS_PER_FRAME, MJPEG_MAX_BYTES_PER_FRAME);
+
+    return passed == 3 ? 0 : 1;
+}
+
+#include "allocsteady.moc"
@@ -0,0 +1,40 @@
+#-------------------------------------------------
+#
+# Steady state allocation test for the capture loop.
+# Build : qmake && make,  Run : ./AllocSteady   (exit code 0 on pass)
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = AllocSteady
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += USBVIDEO_ALLOC_TRACKING
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        allocsteady.cpp \
+    ../usbvideo.cpp \
+    ../alloctracker.cpp \
+    ../colorconvert.cpp \
+    ../temporaldenoise.cpp \
+    ../framehash.cpp \
+    ../metrics.cpp \
+    ../snapshotwriter.cpp
+
+HEADERS += \
+    ../usbvideo.h \
+    ../alloctracker.h \
+    ../colorconvert.h \
+    ../temporaldenoise.h \
+    ../framehash.h \
+    ../metrics.h \
+    ../snapshotwriter.h
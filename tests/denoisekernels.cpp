@@ -0,0 +1,96 @@
+// --------------------------------------------------------------- //
+// CKim - Checks the SSE2 / NEON row kernels of the temporal denoiser
+// against the scalar ones (see temporaldenoise.h). Random rows of every
+// length up to a few vectors, at every misalignment, with every blend
+// weight, plus the extreme differences where 16 bit lanes could overflow
+// and the rounding of the NEON shift differs. Results must be identical.
+// Exits non-zero if any check fails.
+// --------------------------------------------------------------- //
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "temporaldenoise.h"
+
+#define TEST_MAX_BYTES  100     // several 16 byte vectors plus every tail length
+#define TEST_MAX_SHIFT  16      // start offsets, covers every misalignment
+#define TEST_MAX_ALPHA  128     // Q7, 128 takes the new frame as is
+#define TEST_ROUNDS     20      // random rows per length
+
+static uint32_t s_seed = 12345;
+
+static uint8_t nextByte()
+{
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (uint8_t)(s_seed >> 24);
+}
+
+// CKim - Random bytes, or only 0 and 255 so that every difference is +-255
+static void fillRow(uint8_t* p, int bytes, bool extreme)
+{
+    for (int i = 0; i < bytes; ++i)     {   p[i] = extreme ? (nextByte() & 1) * 255 : nextByte();  }
+}
+
+static int checkRow(int bytes, int shift, bool extreme)
+{
+    uint8_t cur[TEST_MAX_BYTES + TEST_MAX_SHIFT], hist[TEST_MAX_BYTES + TEST_MAX_SHIFT];
+    uint8_t refCur[TEST_MAX_BYTES], refHist[TEST_MAX_BYTES];
+    uint8_t* c = cur + shift;
+    uint8_t* h = hist + shift;
+
+    fillRow(c, bytes, extreme);
+    fillRow(h, bytes, extreme);
+    uint32_t sad = DenoiseSadRow(c, h, bytes);
+    uint32_t refSad = DenoiseSadRowScalar(c, h, bytes);
+    if (sad != refSad)
+    {
+        printf("FAIL sad : %d bytes at +%d, %u instead of %u\n", bytes, shift, sad, refSad);
+        return 0;
+    }
+
+    for (int alpha = 0; alpha <= TEST_MAX_ALPHA; ++alpha)
+    {
+        fillRow(c, bytes, extreme);
+        fillRow(h, bytes, extreme);
+        memcpy(refCur, c, bytes);
+        memcpy(refHist, h, bytes);
+
+        DenoiseBlendRow(c, h, bytes, alpha);
+        DenoiseBlendRowScalar(refCur, refHist, bytes, alpha);
+        if (memcmp(c, refCur, bytes) != 0 || memcmp(h, refHist, bytes) != 0)
+        {
+            printf("FAIL blend : %d bytes at +%d, alpha %d\n", bytes, shift, alpha);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main()
+{
+    int failed = 0;
+    long rows = 0;
+    for (int bytes = 0; bytes <= TEST_MAX_BYTES; ++bytes)
+    {
+        for (int shift = 0; shift < TEST_MAX_SHIFT; ++shift)
+        {
+            for (int round = 0; round < TEST_ROUNDS; ++round)
+            {
+                failed += !checkRow(bytes, shift, false);
+                failed += !checkRow(bytes, shift, true);
+                rows += 2;
+            }
+        }
+    }
+
+#if defined(__SSE2__)
+    const char* path = "SSE2";
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const char* path = "NEON";
+#else
+    const char* path = "scalar only";
+#endif
+    printf("%s %s : %ld rows, %d mismatching\n", failed ? "FAIL" : "PASS", path, rows, failed);
+    return failed ? 1 : 0;
+}
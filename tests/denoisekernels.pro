@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# SIMD against scalar kernels of the temporal denoiser.
+# Build : qmake && make,  Run : ./DenoiseKernels   (exit code 0 on pass)
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = DenoiseKernels
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        denoisekernels.cpp \
+    ../temporaldenoise.cpp
+
+HEADERS += \
+    ../temporaldenoise.h
@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# All tests. Build : qmake && make
+# Each project gets its own Makefile, they share this directory.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = allocsteady denoisekernels
+
+allocsteady.file = allocsteady.pro
+allocsteady.makefile = Makefile.allocsteady
+denoisekernels.file = denoisekernels.pro
+denoisekernels.makefile = Makefile.denoisekernels
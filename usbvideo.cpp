@@ -1,10 +1,65 @@
 #include "usbvideo.h"
 #include <QImage>
+#include <QImageReader>
+#include <QBuffer>
+
+#include <time.h>
+#include <math.h>
 
 UsbVideo::UsbVideo(QObject* parent) : QThread(parent)
 {
     m_fd = -1;
     runThread = false;
+    m_bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    CLEAR(m_pixformat);
+    CLEAR(m_pixformatMp);
+    m_buffers = NULL;
+    m_buffersCapacity = 0;
+    m_numBuffers = 0;
+    m_poolIndex = 0;
+    CLEAR(m_allocStats);
+    m_jpegReader.setFormat("JPG");
+
+    m_rtConfig.policy = SCHED_OTHER;
+    m_rtConfig.priority = 0;
+    m_rtConfig.captureCpu = -1;
+    m_rtConfig.lockMemory = false;
+    m_rtConfig.prefault = false;
+    CPU_ZERO(&m_rtConfig.decodeCpus);
+    m_memoryLocked = false;
+    m_frameIntervalUs = 0;
+    CLEAR(m_jitterStats);
+
+    m_denoiseStrength = 0;
+
+    m_lastFrameHash = 0;
+    m_lastFrameSize = -1;
+    m_repeatCount = 0;
+    m_frozenThreshold = FROZEN_FRAME_THRESHOLD;
+    m_frozenReported = false;
+    m_repeatedFrames = 0;
+    m_lastNewFrameNs = 0;
+
+    m_lastSequence = -1;
+    m_decodeStartNs = 0;
+    m_rateStartNs = 0;
+    m_rateBytes = 0;
+
+    m_snapRequested = false;
+    m_snapBurst = 1;
+    m_snapRemaining = 0;
+    m_snapThisFrame = false;
+    m_snapHaveCandidate = false;
+    m_frameSharpness = -1;
+    m_frameImage = NULL;
+    m_framePayload = NULL;
+    m_framePayloadSize = 0;
+    connect(&m_snapWriter, SIGNAL(saved(QString)), this, SIGNAL(snapshotSaved(QString)));
+    connect(&m_snapWriter, SIGNAL(failed(QString)), this, SIGNAL(reportError(QString)));
+
+    m_iomethod = IO_METHOD_READ;
+    m_fileData = NULL;
+    m_fileMaxFrames = 0;
 }
 
 int UsbVideo::xioctl(int fh, int request, void *arg)
@@ -58,20 +113,183 @@ int UsbVideo::OpenDevice(const char* dev_name)
         }
     }
 
-    if (!(m_cap.capabilities & V4L2_CAP_VIDEO_CAPTURE))
+    // CKim - Prefer the single-planar API. CSI cameras, ISP nodes and many capture bridges
+    // only offer the multi-planar one. device_caps describes this node, capabilities the whole device.
+    unsigned int caps = (m_cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? m_cap.device_caps : m_cap.capabilities;
+    if (caps & V4L2_CAP_VIDEO_CAPTURE)
+    {
+        m_bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    }
+    else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+    {
+        m_bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    }
+    else
     {
         m_errStr.sprintf("%s is no video capture device", dev_name);
         return 0;
     }
 
     sprintf(m_deviceName,"%s",dev_name);
-    m_msgStr.sprintf("Successfully opened %s",m_deviceName);
+    m_msgStr.sprintf("Successfully opened %s%s",m_deviceName,
+                     m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ? " (multi-planar)" : "");
+
+    return 1;
+}
+
+int UsbVideo::OpenFrameFile(const char* file_name, int width, int height, unsigned int pixelformat,
+                            double frameIntervalUs, unsigned long maxFrames)
+{
+    // CKim - Stand-in for a camera. Loads a recorded stream into memory so that
+    // run() can replay it through the same decode and display path.
+    FILE* fp = fopen(file_name, "rb");
+    if (!fp) {
+        m_errStr.sprintf("Cannot open '%s': %d, %s", file_name, errno, strerror(errno));
+        return 0;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    unsigned char* data = (unsigned char*)malloc(fileSize > 0 ? fileSize : 1);
+    if (!data || (long)fread(data, 1, fileSize, fp) != fileSize) {
+        m_errStr.sprintf("Cannot read '%s'", file_name);
+        free(data);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    // CKim - First pass counts the frames and validates the lengths
+    int count = 0;
+    long pos = 0;
+    while (pos + 4 <= fileSize)
+    {
+        uint32_t len = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | ((uint32_t)data[pos+3] << 24);
+        if (len == 0 || pos + 4 + (long)len > fileSize)  {   break;  }
+        pos += 4 + len;
+        count++;
+    }
+    if (count == 0 || pos != fileSize) {
+        m_errStr.sprintf("%s is not a valid frame file", file_name);
+        free(data);
+        return 0;
+    }
+
+    // CKim - Multi-planar formats are stored like their single buffer counterpart, Y then
+    // chroma, and split into planes below so that replay goes through process_planes()
+    int numPlanes = 1;
+    if (pixelformat == V4L2_PIX_FMT_NV12M || pixelformat == V4L2_PIX_FMT_NV21M)    {   numPlanes = 2;  }
+    else if (pixelformat == V4L2_PIX_FMT_YUV420M)                                   {   numPlanes = 3;  }
+
+    int planeStride[3] = { width, 0, 0 };
+    size_t planeSize[3] = { (size_t)width * height, 0, 0 };
+    size_t framePlanes = planeSize[0];
+    for (int p = 1; p < numPlanes; ++p)
+    {
+        planeStride[p] = (numPlanes == 3) ? (width + 1) / 2 : width;
+        planeSize[p] = (size_t)planeStride[p] * ((height + 1) / 2);
+        framePlanes += planeSize[p];
+    }
+
+    pos = 0;
+    for (int i = 0; numPlanes > 1 && i < count; ++i)
+    {
+        uint32_t len = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | ((uint32_t)data[pos+3] << 24);
+        if (len < framePlanes) {
+            m_errStr.sprintf("%s : frame %d is shorter than %d planes", file_name, i, numPlanes);
+            free(data);
+            return 0;
+        }
+        pos += 4 + len;
+    }
+
+    if (count > m_buffersCapacity)
+    {
+        free(m_buffers);
+        m_buffers = (buffer*)calloc(count, sizeof(*m_buffers));
+        m_buffersCapacity = m_buffers ? count : 0;
+        if (!m_buffers) {
+            m_errStr.sprintf("Out of memory\n");
+            free(data);
+            return 0;
+        }
+    }
+
+    pos = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        uint32_t len = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | ((uint32_t)data[pos+3] << 24);
+        m_buffers[i].start = data + pos + 4;
+        m_buffers[i].length = len;
+        m_buffers[i].num_planes = 1;
+        m_buffers[i].plane_start[0] = m_buffers[i].start;
+        m_buffers[i].plane_length[0] = len;
+        pos += 4 + len;
+    }
+
+    free(m_fileData);
+    m_fileData = data;
+    m_numBuffers = count;
+    m_fileMaxFrames = maxFrames;
+    m_frameIntervalUs = frameIntervalUs;
+
+    CLEAR(m_pixformat);
+    m_pixformat.width = width;
+    m_pixformat.height = height;
+    m_pixformat.pixelformat = pixelformat;
+    m_pixformat.bytesperline = (pixelformat == V4L2_PIX_FMT_YUYV) ? width * 2 :
+                               (pixelformat == V4L2_PIX_FMT_MJPEG) ? 0 : width;
+    m_bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (numPlanes > 1)
+    {
+        CLEAR(m_pixformatMp);
+        m_pixformatMp.width = width;
+        m_pixformatMp.height = height;
+        m_pixformatMp.pixelformat = pixelformat;
+        m_pixformatMp.num_planes = numPlanes;
+        for (int p = 0; p < numPlanes; ++p)
+        {
+            m_pixformatMp.plane_fmt[p].bytesperline = planeStride[p];
+            m_pixformatMp.plane_fmt[p].sizeimage = planeSize[p];
+        }
 
+        for (int i = 0; i < count; ++i)
+        {
+            unsigned char* start = (unsigned char*)m_buffers[i].start;
+            size_t offset = 0;
+            for (int p = 0; p < numPlanes; ++p)
+            {
+                m_buffers[i].plane_start[p] = start + offset;
+                m_buffers[i].plane_length[p] = planeSize[p];
+                offset += planeSize[p];
+            }
+            m_buffers[i].num_planes = numPlanes;
+        }
+        m_bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    }
+
+    sprintf(m_deviceName,"%.99s",file_name);
+    m_msgStr.sprintf("Loaded %d frames from %s", count, m_deviceName);
     return 1;
 }
 
 int UsbVideo::InitializeDevice(io_method io, int vformat)
 {
+    // CKim - Frames and format already set by OpenFrameFile()
+    if (io == IO_METHOD_FILE)
+    {
+        if (!m_fileData) {
+            m_errStr.sprintf("Frame file not opened!!\n");
+            return 0;
+        }
+        m_iomethod = io;
+        m_msgStr.sprintf("Successfully Initialized Video");
+        return 1;
+    }
+
     // CKim - Return if handle is not valid
     if (-1 == m_fd) {
         m_errStr.sprintf("Device not opened!!\n");
@@ -79,13 +297,42 @@ int UsbVideo::InitializeDevice(io_method io, int vformat)
     }
 
     // CKim - Get current video format set by the device
-    m_format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;    // type must be set before calling VIDIOC_G_FMT
+    m_format.type = m_bufType;    // type must be set before calling VIDIOC_G_FMT
     if (-1 == xioctl(m_fd, VIDIOC_G_FMT, &m_format))
     {
          m_errStr.sprintf("VIDIOC_G_FMT error %d, %s\n", errno, strerror(errno));
          return 0;
      }
-    m_pixformat = m_format.fmt.pix;
+
+    if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+    {
+        // CKim - Keep the per plane layout and fill the single-planar description
+        // with plane 0 so that frame size and stride queries work the same way
+        m_pixformatMp = m_format.fmt.pix_mp;
+        CLEAR(m_pixformat);
+        m_pixformat.width = m_pixformatMp.width;
+        m_pixformat.height = m_pixformatMp.height;
+        m_pixformat.pixelformat = m_pixformatMp.pixelformat;
+        m_pixformat.field = m_pixformatMp.field;
+        m_pixformat.colorspace = m_pixformatMp.colorspace;
+        m_pixformat.bytesperline = m_pixformatMp.plane_fmt[0].bytesperline;
+        for (int p = 0; p < m_pixformatMp.num_planes; ++p)
+            m_pixformat.sizeimage += m_pixformatMp.plane_fmt[p].sizeimage;
+    }
+    else
+    {
+        m_pixformat = m_format.fmt.pix;
+    }
+
+    // CKim - Get the frame interval, used as the reference for the jitter report
+    struct v4l2_streamparm parm;
+    CLEAR(parm);
+    parm.type = m_bufType;
+    m_frameIntervalUs = 0;
+    if (0 == xioctl(m_fd, VIDIOC_G_PARM, &parm) && parm.parm.capture.timeperframe.denominator)
+    {
+        m_frameIntervalUs = 1e6 * parm.parm.capture.timeperframe.numerator / parm.parm.capture.timeperframe.denominator;
+    }
 
     // CKim - In future, dependng on the vformat, change image format
     // CKim - Negotiate data format. Asks for a particular format and the driver selects and reports the
@@ -117,6 +364,18 @@ int UsbVideo::StartCapture()
     // it is customary to first enqueue all mapped buffers, then to start capturing and enter the read loop.
     enum v4l2_buf_type type;
 
+    // CKim - Lock current and future pages so that page faults do not add latency to the loop.
+    // Done before any buffer is queued, so that a failure leaves the device untouched.
+    if (m_rtConfig.lockMemory && !m_memoryLocked)
+    {
+        if (-1 == mlockall(MCL_CURRENT | MCL_FUTURE))
+        {
+            m_errStr.sprintf("mlockall error %d, %s\n", errno, strerror(errno));
+            return 0;
+        }
+        m_memoryLocked = true;
+    }
+
     switch (m_iomethod) {
 
     case IO_METHOD_MMAP:
@@ -124,11 +383,18 @@ int UsbVideo::StartCapture()
         {
             // CKim - Prepare buffer
             struct v4l2_buffer buf;
+            struct v4l2_plane planes[VIDEO_MAX_PLANES];
 
             CLEAR(buf);
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.type = m_bufType;
             buf.memory = V4L2_MEMORY_MMAP;
             buf.index = i;
+            if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+            {
+                CLEAR(planes);
+                buf.m.planes = planes;
+                buf.length = m_buffers[i].num_planes;
+            }
 
             // CKim - To enqueue a buffer use the VIVIOC_QBUF ioctl.
             if (-1 == xioctl(m_fd, VIDIOC_QBUF, &buf))
@@ -139,12 +405,14 @@ int UsbVideo::StartCapture()
         }
 
         // CKim - To start capturing call the VIDIOC_STREAMON ioctl.
-        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        type = m_bufType;
         if (-1 == xioctl(m_fd, VIDIOC_STREAMON, &type))
         {
             m_errStr.sprintf("VIDIOC_STREAMON error %d, %s\n", errno, strerror(errno));
             return 0;
         }
+        Metrics::Set(METRIC_DRIVER_QUEUED, m_numBuffers);
+        Metrics::Set(METRIC_DRIVER_HELD, 0);
         break;
 
 //    case IO_METHOD_USERPTR:
@@ -176,6 +444,26 @@ int UsbVideo::StartCapture()
     // https://doc.qt.io/qt-5/qtcore-threads-mandelbrot-example.html
     if (!this->isRunning())
     {
+        CLEAR(m_allocStats);
+        CLEAR(m_jitterStats);
+        m_denoiser.Reset();
+        m_lastFrameSize = -1;
+        m_repeatCount = 0;
+        m_frozenReported = false;
+        m_repeatedFrames = 0;
+        m_lastSequence = -1;
+        m_rateStartNs = 0;
+
+        // CKim - A snapshot pending or half way through a burst belongs to the previous session
+        m_snapRequested = false;
+        m_snapRemaining = 0;
+        m_snapThisFrame = false;
+        m_snapHaveCandidate = false;
+        m_snapJob = snapshot_job();
+        m_frameSharpness = -1;
+        m_frameImage = NULL;
+        m_framePayload = NULL;
+        m_framePayloadSize = 0;
         runThread = true;
         this->start(HighestPriority);
     }
@@ -187,20 +475,25 @@ int UsbVideo::StopCapture()
 {
     runThread = false;
     while(this->isRunning())    {}
+    if (AllocTracker::isEnabled())  {   PrintAllocStats();  }
     enum v4l2_buf_type type;
 
     switch (m_iomethod) {
     case IO_METHOD_READ:
+    case IO_METHOD_FILE:
         /* Nothing to do. */
         break;
 
     case IO_METHOD_MMAP:
     case IO_METHOD_USERPTR:
-        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        type = m_bufType;
         if (-1 == xioctl(m_fd, VIDIOC_STREAMOFF, &type)) {
             m_errStr.sprintf("VIDIOC_STREAMOFF error %d, %s\n", errno, strerror(errno));
             return 0;
         }
+        // CKim - STREAMOFF returns every buffer to the application, dequeued or not
+        Metrics::Set(METRIC_DRIVER_QUEUED, 0);
+        Metrics::Set(METRIC_DRIVER_HELD, 0);
         break;
     }
 
@@ -219,6 +512,8 @@ int UsbVideo::ClearTimeoutError()
 
 int UsbVideo::RestartCapture()
 {
+    if (m_iomethod == IO_METHOD_FILE)   {   return StartCapture();  }
+
     // 2a. Using memory map,
     int res = init_mmap();
     if(!res)    {   return 0;   }
@@ -236,32 +531,56 @@ int UsbVideo::ClearBuffer()
 
     case IO_METHOD_MMAP:
         for (int i = 0; i < m_numBuffers; ++i)
-            if (-1 == munmap(m_buffers[i].start, m_buffers[i].length)) {
-                m_errStr.sprintf("munmap error %d, %s\n", errno, strerror(errno));
-                return 0;
-            }
+            for (int p = 0; p < m_buffers[i].num_planes; ++p)
+                if (-1 == munmap(m_buffers[i].plane_start[p], m_buffers[i].plane_length[p])) {
+                    m_errStr.sprintf("munmap error %d, %s\n", errno, strerror(errno));
+                    return 0;
+                }
         break;
 
     case IO_METHOD_USERPTR:
         for (int i = 0; i < m_numBuffers; ++i)
             free(m_buffers[i].start);
         break;
+
+    case IO_METHOD_FILE:
+        // CKim - Frames stay loaded for the next StartCapture(), freed in CloseDevice()
+        return 1;
     }
 
-    free(m_buffers);
+    // CKim - Keep the buffer array itself. init_mmap() reuses it on restart
+    // and it is released in CloseDevice()
+    m_numBuffers = 0;
     return 1;
 }
 
 int UsbVideo::CloseDevice()
 {
-    // CKim - Close handle
-    if (-1 == close(m_fd))
+    // CKim - Close handle. File-fed source only has the loaded frames to release.
+    if (m_fileData)
+    {
+        free(m_fileData);
+        m_fileData = NULL;
+        m_numBuffers = 0;
+    }
+    else if (-1 == close(m_fd))
     {
         m_errStr.sprintf("close error %d, %s\n", errno, strerror(errno));
         return 0;  //errno_exit("close");
     }
     m_msgStr.sprintf("\nClosing Device \n");
     m_fd = -1;
+
+    if (m_memoryLocked)
+    {
+        munlockall();
+        m_memoryLocked = false;
+    }
+
+    free(m_buffers);
+    m_buffers = NULL;
+    m_buffersCapacity = 0;
+    return 1;
 }
 
 void UsbVideo::run()
@@ -269,11 +588,24 @@ void UsbVideo::run()
     m_msgStr.sprintf("mainloop() : Dequeue and process buffers");
     emit reportError(m_msgStr);
 
+    // CKim - Scheduling policy and affinity apply to the calling thread, so set them from here
+    applyRealtimeConfig();
+
+    if (m_iomethod == IO_METHOD_FILE)
+    {
+        runFileFed();
+        return;
+    }
+
+    // CKim - Only sample the counters when the tracker is compiled in
+    const bool trackAlloc = AllocTracker::isEnabled();
+
     // CKim - Here the application waits until a filled buffer can be dequeued,
     while (runThread)
     {
         fd_set fds;     struct timeval tv;      int r;
         struct v4l2_buffer buf;
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
 
         for (;;)
         {
@@ -297,7 +629,7 @@ void UsbVideo::run()
             // returns 0 for timeout
             if (0 == r)
             {
-                m_errStr.sprintf("select timeout");
+                m_errStr = QStringLiteral("select timeout");
                 emit reportError(m_errStr);
                 emit timeoutError();
                 return;
@@ -308,8 +640,15 @@ void UsbVideo::run()
 
             // CKim - deque buffer, currently only for im_method_mmap case
             CLEAR(buf);
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.type = m_bufType;
             buf.memory = V4L2_MEMORY_MMAP;
+            if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+            {
+                // CKim - Driver fills bytesused and data_offset of each plane here
+                CLEAR(planes);
+                buf.m.planes = planes;
+                buf.length = VIDEO_MAX_PLANES;
+            }
 
             // CKim - To dequeue a buffer use the VIVIOC_DQBUF ioctl.
             if (-1 == xioctl(m_fd, VIDIOC_DQBUF, &buf))
@@ -327,11 +666,41 @@ void UsbVideo::run()
             }
 
             assert(buf.index < m_numBuffers);
+            Metrics::Add(METRIC_DRIVER_QUEUED, -1);
+            Metrics::Add(METRIC_DRIVER_HELD);
+            accumulateJitter();
+            if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+            {
+                int bytes = 0;
+                for (unsigned int p = 0; p < buf.length; ++p)   {   bytes += planes[p].bytesused;   }
+                accountFrame(bytes, buf.sequence);
+            }
+            else
+            {
+                accountFrame(buf.bytesused, buf.sequence);
+            }
+            latchSnapshot();
+
+            alloc_counters before = { 0, 0 };
+            if (trackAlloc)     {   before = AllocTracker::threadCounters();   }
 
             // CKim - Process image.
             // buffers[i].start has pointer to the memory of the ith buffer
             // buf.bytesused has size of the filled data, different from sizeimage due to varying compression
-            process_image(m_buffers[buf.index].start, buf.bytesused);
+            // A frame identical to the previous one is neither decoded nor repainted.
+            if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+                process_planes(m_buffers[buf.index], planes, buf.length);
+            else if (!isRepeatedFrame(m_buffers[buf.index].start, buf.bytesused))
+                process_image(m_buffers[buf.index].start, buf.bytesused);
+
+            // CKim - Compressed data is copied out of the mmap buffer before it goes back to the driver
+            if (m_snapThisFrame)
+            {
+                if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+                    considerSnapshot(m_framePayload, m_framePayloadSize, buf.timestamp, buf.sequence);
+                else
+                    considerSnapshot(m_buffers[buf.index].start, buf.bytesused, buf.timestamp, buf.sequence);
+            }
 
             // CKim - re-enqueues the buffer
             if (-1 == xioctl(m_fd, VIDIOC_QBUF, &buf))
@@ -340,28 +709,575 @@ void UsbVideo::run()
                 emit reportError(m_errStr);
                 return;
             }
+            Metrics::Add(METRIC_DRIVER_HELD, -1);
+            Metrics::Add(METRIC_DRIVER_QUEUED);
 
+            if (trackAlloc)     {   accumulateAllocStats(before);   }
             break;
         }
     }
 }
 
+void UsbVideo::runFileFed()
+{
+    const bool trackAlloc = AllocTracker::isEnabled();
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (unsigned long n = 0; runThread && (m_fileMaxFrames == 0 || n < m_fileMaxFrames); ++n)
+    {
+        // CKim - Pace like a camera if an interval was given, otherwise run as fast as possible
+        if (m_frameIntervalUs > 0)
+        {
+            long ns = next.tv_nsec + (long)(m_frameIntervalUs * 1000);
+            next.tv_sec += ns / 1000000000L;
+            next.tv_nsec = ns % 1000000000L;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+
+        // CKim - Unlike a camera a file never drops frames. Wait until the consumer releases
+        // a pooled image instead of queueing signals without bound.
+        while (runThread && findFreePoolImage() < 0)  {   usleep(100);    }
+        if (!runThread)     {   break;  }
+
+        const buffer& frame = m_buffers[n % m_numBuffers];
+        accumulateJitter();
+        accountFrame(frame.length, -1);
+        latchSnapshot();
+
+        alloc_counters before = { 0, 0 };
+        if (trackAlloc)     {   before = AllocTracker::threadCounters();   }
+
+        if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+        {
+            // CKim - Stand-in for what VIDIOC_DQBUF reports per plane
+            struct v4l2_plane planes[VIDEO_MAX_PLANES];
+            CLEAR(planes);
+            for (int p = 0; p < frame.num_planes; ++p)  {   planes[p].bytesused = frame.plane_length[p];   }
+            process_planes(frame, planes, frame.num_planes);
+        }
+        else if (!isRepeatedFrame(frame.start, frame.length))
+            process_image(frame.start, frame.length);
+
+        if (m_snapThisFrame)
+        {
+            struct timeval tv;
+            tv.tv_sec = m_jitterStats.lastNs / 1000000000ULL;
+            tv.tv_usec = (m_jitterStats.lastNs % 1000000000ULL) / 1000;
+            considerSnapshot(frame.start, frame.length, tv, n);
+        }
+
+        if (trackAlloc)     {   accumulateAllocStats(before);   }
+    }
+}
+
+int UsbVideo::process_planes(const buffer& b, const struct v4l2_plane* planes, int numPlanes)
+{
+    // CKim - Every plane of the negotiated format must be present and mapped
+    if (numPlanes < 1 || numPlanes != m_pixformatMp.num_planes || numPlanes > b.num_planes)
+    {
+        Metrics::Add(METRIC_DECODE_ERRORS);
+        m_errStr = QStringLiteral("Plane count mismatch!!!");
+        emit reportError(m_errStr);
+        return 0;
+    }
+
+    // CKim - Payload of each plane starts data_offset bytes into its mapping
+    const uint8_t* data[VIDEO_MAX_PLANES];
+    int used[VIDEO_MAX_PLANES];
+    for (int p = 0; p < numPlanes; ++p)
+    {
+        if (planes[p].data_offset > planes[p].bytesused || planes[p].bytesused > b.plane_length[p])
+        {
+            Metrics::Add(METRIC_DECODE_ERRORS);
+            m_errStr = QStringLiteral("Bad plane payload!!!");
+            emit reportError(m_errStr);
+            return 0;
+        }
+        data[p] = (const uint8_t*)b.plane_start[p] + planes[p].data_offset;
+        used[p] = planes[p].bytesused - planes[p].data_offset;
+    }
+
+    // CKim - Single plane formats (NV12, YUV420, YUYV, MJPEG) take the same path as single-planar devices
+    if (numPlanes == 1)
+    {
+        // CKim - Kept for considerSnapshot(), MJPEG snapshots are saved from the payload
+        m_framePayload = data[0];
+        m_framePayloadSize = used[0];
+        if (isRepeatedFrame(data[0], used[0]))  {   return 1;   }
+        return process_image((void*)data[0], used[0]);
+    }
+
+    // CKim - NV12M / NV21M : Y plane + interleaved chroma plane. YUV420M : Y, U and V planes.
+    // Each plane must hold the rows the conversion reads, like the single buffer check in process_image().
+    const struct v4l2_plane_pix_format* fmt = m_pixformatMp.plane_fmt;
+    int h = m_pixformat.height;
+    int chromaRows = (h + 1) / 2;
+    if (numPlanes > 3 || fmt[0].bytesperline == 0 || used[0] < (int)fmt[0].bytesperline * h)
+    {
+        Metrics::Add(METRIC_DECODE_ERRORS);
+        m_errStr = QStringLiteral("Short YUV420 frame!!!");
+        emit reportError(m_errStr);
+        return 0;
+    }
+    for (int p = 1; p < numPlanes; ++p)
+    {
+        if (fmt[p].bytesperline == 0 || used[p] < (int)fmt[p].bytesperline * chromaRows)
+        {
+            Metrics::Add(METRIC_DECODE_ERRORS);
+            m_errStr = QStringLiteral("Short YUV420 frame!!!");
+            emit reportError(m_errStr);
+            return 0;
+        }
+    }
+
+    if (numPlanes == 2)
+    {
+        return process_yuv420(data[0], fmt[0].bytesperline, data[1], NULL, fmt[1].bytesperline);
+    }
+    return process_yuv420(data[0], fmt[0].bytesperline, data[1], data[2], fmt[1].bytesperline);
+}
+
+int UsbVideo::process_yuv420(const uint8_t* y, int yStride, const uint8_t* u, const uint8_t* v, int uvStride)
+{
+    // CKim - Converted straight from the mmap buffer into a pooled image, no intermediate copy
+    int w = m_pixformat.width;
+    int h = m_pixformat.height;
+    QImage& image = nextPoolImage(w, h);
+
+    switch (m_pixformat.pixelformat) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12M:
+        ConvertNV12ToRGB32(y, yStride, u, uvStride, false, w, h, image.bits(), image.bytesPerLine());
+        break;
+
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV21M:
+        ConvertNV12ToRGB32(y, yStride, u, uvStride, true, w, h, image.bits(), image.bytesPerLine());
+        break;
+
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YUV420M:
+        ConvertYUV420ToRGB32(y, yStride, u, v, uvStride, w, h, image.bits(), image.bytesPerLine());
+        break;
+
+    default:
+        Metrics::Add(METRIC_DECODE_ERRORS);
+        m_errStr = QStringLiteral("Unsupported planar format!!!");
+        emit reportError(m_errStr);
+        return 0;
+    }
+
+    deliverImage(image);
+    return 1;
+}
+
 int UsbVideo::process_image(void *p, int size)
 {
+    int w = m_pixformat.width;
+    int h = m_pixformat.height;
+
+    // CKim - Uncompressed YUYV. Convert straight from the buffer into a pooled image.
+    if (m_pixformat.pixelformat == V4L2_PIX_FMT_YUYV)
+    {
+        int stride = m_pixformat.bytesperline ? m_pixformat.bytesperline : w * 2;
+        if (size < stride * h)
+        {
+            Metrics::Add(METRIC_DECODE_ERRORS);
+            m_errStr = QStringLiteral("Short YUYV frame!!!");
+            emit reportError(m_errStr);
+            return 0;
+        }
+
+        QImage& image = nextPoolImage(w, h);
+        ConvertYUYVToRGB32((const uint8_t*)p, stride, w, h, image.bits(), image.bytesPerLine());
+        deliverImage(image);
+        return 1;
+    }
+
+    // CKim - 4:2:0 in one buffer, chroma follows the luma plane. Chroma stride is the
+    // luma stride for interleaved NV12 / NV21 and half of it for planar YUV420.
+    if (m_pixformat.pixelformat == V4L2_PIX_FMT_NV12 || m_pixformat.pixelformat == V4L2_PIX_FMT_NV21 ||
+        m_pixformat.pixelformat == V4L2_PIX_FMT_YUV420)
+    {
+        int stride = m_pixformat.bytesperline ? m_pixformat.bytesperline : w;
+        int chromaRows = (h + 1) / 2;
+        if (size < stride * h + stride * chromaRows)
+        {
+            Metrics::Add(METRIC_DECODE_ERRORS);
+            m_errStr = QStringLiteral("Short YUV420 frame!!!");
+            emit reportError(m_errStr);
+            return 0;
+        }
+
+        const uint8_t* y = (const uint8_t*)p;
+        const uint8_t* u = y + stride * h;
+        if (m_pixformat.pixelformat == V4L2_PIX_FMT_YUV420)
+        {
+            return process_yuv420(y, stride, u, u + (stride / 2) * chromaRows, stride / 2);
+        }
+        return process_yuv420(y, stride, u, NULL, stride);
+    }
+
     // CKim - decode jpg by using Qt QImage's loading function
     //bool res = m_convertedImage.loadFromData((const uchar*)p,size,"JPG");
-    bool res = m_renderedImage.loadFromData((const uchar*)p,size,"JPG");
+    // CKim - QImage::loadFromData() always returns a fresh image. QImageReader::read(QImage*)
+    // decodes into the given image and keeps its pixel buffer when size and format match.
+    // fromRawData() wraps the mmap buffer without copying the compressed data, and the
+    // buffer and reader are reused so that only the JPEG handler is created per frame.
+    m_jpegBuffer.close();
+    m_jpegBuffer.setData(QByteArray::fromRawData((const char*)p, size));
+    m_jpegBuffer.open(QIODevice::ReadOnly);
+    m_jpegReader.setDevice(&m_jpegBuffer);
+
+    QImage& image = nextPoolImage();
+    bool res = m_jpegReader.read(&image);
     if(res)
     {
 //        // CKim - Perform deepcopy and send it for rendering.
 //        m_renderedImage = m_convertedImage.copy();
-        emit renderedImage(m_renderedImage);
+        deliverImage(image);
+        return 1;
     }
     else
     {
-        m_errStr.sprintf("Failed to Decode!!!");
+        Metrics::Add(METRIC_DECODE_ERRORS);
+        m_errStr = QStringLiteral("Failed to Decode!!!");
+        emit reportError(m_errStr);
+        return 0;
+    }
+}
+
+bool UsbVideo::isRepeatedFrame(const void* p, int size)
+{
+    // CKim - Stalled sensors and static scenes make MJPEG cameras resend byte identical
+    // frames. Raw formats always differ by sensor noise, so only compressed data is hashed.
+    if (m_pixformat.pixelformat != V4L2_PIX_FMT_MJPEG)  {   return false;   }
+
+    uint64_t hash = HashFrame(p, size);
+    bool same = (size == m_lastFrameSize && hash == m_lastFrameHash);
+    m_lastFrameHash = hash;
+    m_lastFrameSize = size;
+
+    if (!same)
+    {
+        if (m_frozenReported)
+        {
+            m_frozenReported = false;
+            emit streamResumed();
+        }
+        m_repeatCount = 1;
+        m_lastNewFrameNs = m_jitterStats.lastNs;
+        return false;
+    }
+
+    // CKim - Only the timestamps move on. Flag a stuck camera instead of showing it as live.
+    m_repeatCount++;
+    m_repeatedFrames++;
+    Metrics::Add(METRIC_FRAMES_REPEATED);
+    if (m_frozenThreshold > 0 && m_repeatCount >= m_frozenThreshold && !m_frozenReported)
+    {
+        m_frozenReported = true;
+        emit frozenStream(m_repeatCount);
+    }
+    return true;
+}
+
+void UsbVideo::applyDenoise(QImage& image)
+{
+    // CKim - Filters the pooled image in place, so no extra frame of latency
+    int strength = m_denoiseStrength;
+    if (strength != m_denoiser.GetStrength())   {   m_denoiser.SetStrength(strength);   }
+
+    // CKim - Colour JPEGs and YUYV both decode to RGB32. Anything else is passed through.
+    if (strength == 0 || image.format() != QImage::Format_RGB32)
+    {
+        m_denoiser.Reset();
+        return;
+    }
+    m_denoiser.Process(image.bits(), image.bytesPerLine(), image.width(), image.height());
+}
+
+int UsbVideo::findFreePoolImage()
+{
+    // CKim - Next image no one else references. An image still shared with the
+    // GUI (queued signal or being painted) would detach, i.e. allocate, when written to.
+    for (int i = 0; i < IMAGE_POOL_SIZE; ++i)
+    {
+        int idx = (m_poolIndex + i) % IMAGE_POOL_SIZE;
+        if (m_imagePool[idx].isNull() || m_imagePool[idx].isDetached())     {   return idx;     }
+    }
+    return -1;
+}
+
+QImage& UsbVideo::nextPoolImage()
+{
+    // CKim - If the GUI is lagging behind and all images are in use, fall back to round robin.
+    int idx = findFreePoolImage();
+    if (idx < 0)    {   idx = m_poolIndex;  }
+    m_poolIndex = (idx + 1) % IMAGE_POOL_SIZE;
+    return m_imagePool[idx];
+}
+
+QImage& UsbVideo::nextPoolImage(int width, int height)
+{
+    // CKim - Pooled RGB32 image for raw formats, reallocated only when the size changes
+    QImage& image = nextPoolImage();
+    if (image.width() != width || image.height() != height || image.format() != QImage::Format_RGB32)
+    {
+        image = QImage(width, height, QImage::Format_RGB32);
+    }
+    return image;
+}
+
+void UsbVideo::applyRealtimeConfig()
+{
+    pthread_t self = pthread_self();
+
+    // CKim - main.cpp checks against the configured CPUs, this only keeps CPU_SET() in bounds
+    if (m_rtConfig.captureCpu >= CPU_SETSIZE)
+    {
+        m_errStr.sprintf("Cannot pin capture thread to CPU %d: out of range", m_rtConfig.captureCpu);
         emit reportError(m_errStr);
     }
+    else if (m_rtConfig.captureCpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_rtConfig.captureCpu, &cpus);
+        int err = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+        if (err)
+        {
+            m_errStr.sprintf("Cannot pin capture thread to CPU %d: %s", m_rtConfig.captureCpu, strerror(err));
+            emit reportError(m_errStr);
+        }
+    }
+
+    if (m_rtConfig.policy == SCHED_FIFO || m_rtConfig.policy == SCHED_RR)
+    {
+        struct sched_param param;
+        CLEAR(param);
+        param.sched_priority = m_rtConfig.priority;
+        int err = pthread_setschedparam(self, m_rtConfig.policy, &param);
+        if (err)
+        {
+            // CKim - Not fatal. Keep capturing with the normal policy.
+            m_errStr.sprintf("Cannot set %s priority %d: %s",
+                             m_rtConfig.policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR",
+                             m_rtConfig.priority, strerror(err));
+            emit reportError(m_errStr);
+        }
+    }
+
+    // CKim - The capture thread waits for the denoise bands every frame, so the pool threads
+    // get the policy this thread actually ended up with. Their CPUs are configured apart,
+    // otherwise they would inherit the capture thread's pinning and run one after another.
+    int policy;
+    struct sched_param current;
+    if (pthread_getschedparam(self, &policy, &current) == 0)
+    {
+        cpu_set_t cpus = m_rtConfig.decodeCpus;
+        if (CPU_COUNT(&cpus) == 0 && sched_getaffinity(getpid(), sizeof(cpus), &cpus) != 0)
+        {
+            CPU_ZERO(&cpus);
+        }
+        m_denoiser.SetThreadConfig(policy, current.sched_priority, CPU_COUNT(&cpus) ? &cpus : NULL);
+    }
+}
+
+void UsbVideo::accountFrame(int bytes, int64_t sequence)
+{
+    // CKim - Called right after accumulateJitter(), so lastNs is the dequeue time
+    uint64_t now = m_jitterStats.lastNs;
+    m_decodeStartNs = now;
+
+    Metrics::Add(METRIC_FRAMES_DEQUEUED);
+    Metrics::Add(METRIC_BYTES_TOTAL, bytes);
+
+    // CKim - The driver numbers every frame it captures, a jump means frames were lost
+    if (sequence >= 0)
+    {
+        if (m_lastSequence >= 0 && sequence > m_lastSequence + 1)
+            Metrics::Add(METRIC_FRAMES_DROPPED, sequence - m_lastSequence - 1);
+        m_lastSequence = sequence;
+    }
+
+    if (m_rateStartNs == 0)
+    {
+        m_rateStartNs = now;
+        m_rateBytes = 0;
+    }
+    m_rateBytes += bytes;
+    if (now - m_rateStartNs >= 1000000000ULL)
+    {
+        Metrics::Set(METRIC_BYTES_PER_SEC, (int64_t)(m_rateBytes * 1e9 / (now - m_rateStartNs)));
+        m_rateStartNs = now;
+        m_rateBytes = 0;
+    }
+}
+
+void UsbVideo::deliverImage(QImage& image)
+{
+    // CKim - Measured before denoising, which would blur the difference between burst frames
+    if (m_snapThisFrame)
+    {
+        m_frameSharpness = MeasureSharpness(image);
+        m_frameImage = &image;
+    }
+
+    applyDenoise(image);
+
+    // CKim - Time from dequeue to hand-off, includes decode, conversion and denoise
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t dt = (int64_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec - m_decodeStartNs);
+    Metrics::Add(METRIC_DECODE_NS_TOTAL, dt);
+    Metrics::Set(METRIC_DECODE_NS_LAST, dt);
+    Metrics::Add(METRIC_FRAMES_DECODED);
+    Metrics::Add(METRIC_DISPLAY_QUEUE);
+
+    emit renderedImage(image);
+}
+
+int UsbVideo::RequestSnapshot(const QString& fileName, int burst)
+{
+    if (!isRunning())
+    {
+        m_errStr = QStringLiteral("Snapshot needs a running capture");
+        return 0;
+    }
+
+    QMutexLocker lock(&m_snapMutex);
+    if (m_snapRequested)
+    {
+        m_errStr = QStringLiteral("Snapshot already pending");
+        return 0;
+    }
+
+    if (!m_snapWriter.isRunning())  {   m_snapWriter.start(QThread::LowPriority);   }
+    m_snapPath = fileName;
+    m_snapBurst = burst > 0 ? burst : 1;
+    m_snapRequested = true;
+    m_msgStr = QString("Snapshot requested : %1").arg(fileName);
+    return 1;
+}
+
+void UsbVideo::latchSnapshot()
+{
+    // CKim - Decided once per frame before decoding, so a request arriving during the
+    // decode waits for the next frame instead of finding it unmeasured
+    m_snapThisFrame = m_snapRequested || m_snapRemaining > 0;
+    m_frameSharpness = -1;
+    m_frameImage = NULL;
+    m_framePayload = NULL;
+    m_framePayloadSize = 0;
+}
+
+void UsbVideo::considerSnapshot(const void* p, int size, const struct timeval& timestamp, uint32_t sequence)
+{
+    // CKim - A request made during a burst starts after it, the running burst is kept
+    if (m_snapRemaining <= 0 && m_snapRequested)
+    {
+        QMutexLocker lock(&m_snapMutex);
+        m_snapJob = snapshot_job();
+        m_snapJob.path = m_snapPath;
+        m_snapJob.burst = m_snapBurst;
+        m_snapRemaining = m_snapBurst;
+        m_snapHaveCandidate = false;
+        m_snapRequested = false;
+    }
+
+    // CKim - Only MJPEG is kept as received, other formats are saved from the converted image
+    bool compressed = p && m_pixformat.pixelformat == V4L2_PIX_FMT_MJPEG;
+    double sharpness = m_frameSharpness;
+    QImage* image = m_frameImage;
+    m_snapRemaining--;
+
+    // CKim - A repeated MJPEG frame is not decoded, so it has no sharpness of its own.
+    // It equals the previous frame, and is only taken if nothing else was.
+    bool candidate;
+    if (sharpness < 0)  {   candidate = compressed && !m_snapHaveCandidate;  sharpness = 0;  }
+    else                {   candidate = (compressed || image) && (!m_snapHaveCandidate || sharpness > m_snapJob.sharpness);  }
+
+    if (candidate)
+    {
+        if (compressed)
+        {
+            m_snapJob.jpeg.resize(size);
+            memcpy(m_snapJob.jpeg.data(), p, size);
+            m_snapJob.image = QImage();
+        }
+        else
+        {
+            // CKim - Shares the pooled image instead of copying it. The pool skips it
+            // while shared, and the writer thread drops the reference when done.
+            m_snapJob.jpeg.clear();
+            m_snapJob.image = *image;
+        }
+        m_snapJob.deviceTime = timestamp;
+        clock_gettime(CLOCK_REALTIME, &m_snapJob.wallTime);
+        m_snapJob.sequence = sequence;
+        m_snapJob.width = m_pixformat.width;
+        m_snapJob.height = m_pixformat.height;
+        m_snapJob.sharpness = sharpness;
+        m_snapHaveCandidate = true;
+    }
+
+    if (m_snapRemaining > 0)    {   return;     }
+
+    if (!m_snapHaveCandidate)
+    {
+        m_errStr = QString("Snapshot %1 : no frame could be decoded").arg(m_snapJob.path);
+        emit reportError(m_errStr);
+    }
+    else if (!m_snapWriter.Enqueue(m_snapJob))
+    {
+        m_errStr = QString("Snapshot %1 : writer is busy").arg(m_snapJob.path);
+        emit reportError(m_errStr);
+    }
+    m_snapJob = snapshot_job();
+}
+
+void UsbVideo::accumulateJitter()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    jitter_stats& j = m_jitterStats;
+    if (j.lastNs)
+    {
+        double us = (now - j.lastNs) / 1000.0;
+        if (j.count == 0 || us < j.minUs)   {   j.minUs = us;   }
+        if (j.count == 0 || us > j.maxUs)   {   j.maxUs = us;   }
+        j.count++;
+        j.sumUs += us;
+        j.sumSqUs += us * us;
+        if (m_frameIntervalUs > 0 && us > 1.5 * m_frameIntervalUs)  {   j.late++;   }
+
+        int bin = (int)(us / 1000.0);
+        if (bin >= JITTER_HIST_BINS)    {   bin = JITTER_HIST_BINS - 1;     }
+        j.hist[bin]++;
+    }
+    j.lastNs = now;
+}
+
+void UsbVideo::accumulateAllocStats(const alloc_counters& before)
+{
+    alloc_counters after = AllocTracker::threadCounters();
+    uint64_t n = after.count - before.count;
+    uint64_t bytes = after.bytes - before.bytes;
+
+    m_allocStats.frames++;
+    if (m_allocStats.frames <= ALLOC_WARMUP_FRAMES)  {   return;  }
+
+    m_allocStats.steadyFrames++;
+    m_allocStats.allocs += n;
+    m_allocStats.bytes += bytes;
+    if (n)                              {   m_allocStats.allocFrames++;      }
+    if (n > m_allocStats.maxAllocs)     {   m_allocStats.maxAllocs = n;      }
+    if (bytes > m_allocStats.maxBytes)  {   m_allocStats.maxBytes = bytes;   }
 }
 
 int UsbVideo::init_mmap()
@@ -375,7 +1291,7 @@ int UsbVideo::init_mmap()
 
     // CKim - Buffers should be initialized as below, before requesting allocation
     CLEAR(req);
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;     // CKim - buffer type. Should be same as that from the queried struct v4l2_format
+    req.type = m_bufType;                       // CKim - buffer type. Should be same as that from the queried struct v4l2_format
     req.count = 4;//16;                         // CKim - Desired number of buffers
     req.memory = V4L2_MEMORY_MMAP;              // CKim - V4L2_MEMORY_OVERLAY or V4L2_MEMORY_USERPTR or V4L2_MEMORY_DMABUF
 
@@ -403,7 +1319,17 @@ int UsbVideo::init_mmap()
     }
 
     // CKim - calloc(num,size) allocated array of num elements, each being size bytes long and initializes them to zero
-    m_buffers = (buffer*)calloc(req.count, sizeof(*m_buffers));
+    // The array survives ClearBuffer(), so a restart after timeout only allocates if the driver grants more buffers
+    if ((int)req.count > m_buffersCapacity)
+    {
+        free(m_buffers);
+        m_buffers = (buffer*)calloc(req.count, sizeof(*m_buffers));
+        m_buffersCapacity = m_buffers ? req.count : 0;
+    }
+    else
+    {
+        memset(m_buffers, 0, req.count * sizeof(*m_buffers));
+    }
 
     if (!m_buffers) {
         m_errStr.sprintf("Out of memory\n");
@@ -417,11 +1343,19 @@ int UsbVideo::init_mmap()
     {
         // CKim - struct v4l2_buffer
         struct v4l2_buffer buf;
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
 
         CLEAR(buf);
-        buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;  // CKim - Type, same as the requested
+        CLEAR(planes);
+        buf.type        = m_bufType;                    // CKim - Type, same as the requested
         buf.memory      = V4L2_MEMORY_MMAP;             // CKim - memory, same as the requested
         buf.index       = n_buffers;                    // CKim - number of buffers
+        if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+        {
+            // CKim - Multi-planar API returns length and offset of each plane in this array
+            buf.m.planes = planes;
+            buf.length = VIDEO_MAX_PLANES;
+        }
 
         // CKim - Query the status of buffer such as size, device memory location for memory map.
         if (-1 == xioctl(m_fd, VIDIOC_QUERYBUF, &buf)) {
@@ -429,23 +1363,51 @@ int UsbVideo::init_mmap()
             return 0;
         }
 
+        // CKim - Single-planar buffer is handled as one plane
+        int numPlanes = 1;
+        if (m_bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+        {
+            numPlanes = buf.length;
+        }
+        else
+        {
+            planes[0].length = buf.length;
+            planes[0].m.mem_offset = buf.m.offset;
+        }
+        m_buffers[n_buffers].num_planes = numPlanes;
+
         // CKim - map address of buffer in device memory to application memory
         // In the single-planar API case, the m.offset and length returned in a struct v4l2_buffer are passed as sixth and
         // second parameter to the mmap() function. mmap() / munmap() function maps / unmaps files or devices into memory
         // buf.m.offset is the offset of the buffer from the start of the device memory
-        m_buffers[n_buffers].length = buf.length;
-        m_buffers[n_buffers].start =
-                mmap(NULL /* start anywhere */,
-                     buf.length,
-                     PROT_READ | PROT_WRITE /* required */,
-                     MAP_SHARED /* recommended */,
-                     m_fd, buf.m.offset);
-
-        if (MAP_FAILED == m_buffers[n_buffers].start)
+        // In the multi-planar case every plane has its own m.mem_offset and length and is mapped separately
+        for (int p = 0; p < numPlanes; ++p)
         {
-            m_errStr.sprintf("mmap error %d, %s\n", errno, strerror(errno));
-            return 0;
+            m_buffers[n_buffers].plane_length[p] = planes[p].length;
+            m_buffers[n_buffers].plane_start[p] =
+                    mmap(NULL /* start anywhere */,
+                         planes[p].length,
+                         PROT_READ | PROT_WRITE /* required */,
+                         MAP_SHARED /* recommended */,
+                         m_fd, planes[p].m.mem_offset);
+
+            if (MAP_FAILED == m_buffers[n_buffers].plane_start[p])
+            {
+                m_errStr.sprintf("mmap error %d, %s\n", errno, strerror(errno));
+                return 0;
+            }
+
+            // CKim - Fault in the pages now instead of on the first frames after STREAMON
+            if (m_rtConfig.prefault)
+            {
+                long pageSize = sysconf(_SC_PAGESIZE);
+                volatile unsigned char* mem = (volatile unsigned char*)m_buffers[n_buffers].plane_start[p];
+                for (size_t off = 0; off < planes[p].length; off += pageSize)
+                    (void)mem[off];
+            }
         }
+        m_buffers[n_buffers].start = m_buffers[n_buffers].plane_start[0];
+        m_buffers[n_buffers].length = m_buffers[n_buffers].plane_length[0];
     }
 
     m_numBuffers = req.count;
@@ -484,6 +1446,57 @@ void UsbVideo::PrintCapability()
 
 }
 
+void UsbVideo::PrintAllocStats()
+{
+    if (!AllocTracker::isEnabled())
+    {
+        printf("Allocation tracking disabled, build with USBVIDEO_ALLOC_TRACKING\n");
+        return;
+    }
+
+    const alloc_stats& s = m_allocStats;
+    printf("\nCapture loop allocations (after %d warm-up frames)\n", ALLOC_WARMUP_FRAMES);
+    printf("Frames : %lu\n", s.steadyFrames);
+    printf("Frames that allocated : %lu\n", s.allocFrames);
+    printf("Allocations : %llu (%.2f / frame, max %llu)\n", (unsigned long long)s.allocs,
+           s.steadyFrames ? (double)s.allocs / s.steadyFrames : 0.0, (unsigned long long)s.maxAllocs);
+    printf("Bytes : %llu (%.1f / frame, max %llu)\n", (unsigned long long)s.bytes,
+           s.steadyFrames ? (double)s.bytes / s.steadyFrames : 0.0, (unsigned long long)s.maxBytes);
+}
+
+void UsbVideo::PrintJitterReport()
+{
+    const jitter_stats& j = m_jitterStats;
+    printf("\nCapture interval report\n");
+    if (m_frameIntervalUs > 0)  {   printf("Nominal interval : %.1f us\n", m_frameIntervalUs);  }
+    else                        {   printf("Nominal interval : unknown\n");   }
+
+    if (j.count == 0)
+    {
+        printf("No frames captured\n");
+        return;
+    }
+
+    double mean = j.sumUs / j.count;
+    double var = j.sumSqUs / j.count - mean * mean;
+    printf("Intervals : %lu\n", j.count);
+    printf("Mean : %.1f us, Std : %.1f us\n", mean, var > 0 ? sqrt(var) : 0.0);
+    printf("Min : %.1f us, Max : %.1f us\n", j.minUs, j.maxUs);
+    if (m_frameIntervalUs > 0)
+    {
+        printf("Worst deviation : %.1f us\n", j.maxUs - m_frameIntervalUs);
+        printf("Late (> 1.5x nominal) : %lu\n", j.late);
+    }
+
+    // CKim - Print only the non empty bins
+    for (int i = 0; i < JITTER_HIST_BINS; ++i)
+    {
+        if (!j.hist[i])     {   continue;   }
+        if (i == JITTER_HIST_BINS - 1)  {   printf(" >=%3d ms : %lu\n", i, j.hist[i]);    }
+        else                            {   printf("%3d-%3d ms : %lu\n", i, i + 1, j.hist[i]);   }
+    }
+}
+
 void UsbVideo::PrintInputInfo()
 {
     // ---------------------------------------------------- //
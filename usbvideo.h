@@ -22,8 +22,13 @@
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 
+#include <pthread.h>
+#include <sched.h>
+
 #include <linux/videodev2.h>
 
+#include <QBuffer>
+#include <QImageReader>
 #include <QMutex>
 #include <QSize>
 #include <QThread>
@@ -32,6 +37,13 @@
 #include <QLabel>
 #include <QImage>
 
+#include "alloctracker.h"
+#include "colorconvert.h"
+#include "temporaldenoise.h"
+#include "framehash.h"
+#include "metrics.h"
+#include "snapshotwriter.h"
+
 //QT_BEGIN_NAMESPACE
 //class QImage;
 //QT_END_NAMESPACE
@@ -43,15 +55,70 @@
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
+// CKim - Number of decoded images kept for reuse. Must exceed the number of
+// images the GUI can hold at once (one queued + one being painted)
+#define IMAGE_POOL_SIZE     4
+
+// CKim - Frames ignored by the allocation statistics after StartCapture()
+#define ALLOC_WARMUP_FRAMES 30
+
+// CKim - Identical compressed frames in a row before the stream is reported frozen
+#define FROZEN_FRAME_THRESHOLD  30
+
+// CKim - Inter-frame interval histogram, 1 ms per bin, last bin collects the rest
+#define JITTER_HIST_BINS    100
+
+// CKim - One mmap buffer. With the multi-planar API each plane is mapped separately,
+// start / length always describe plane 0 so single-planar code can ignore the rest.
 struct buffer {
         void   *start;
         size_t  length;
+        int     num_planes;
+        void   *plane_start[VIDEO_MAX_PLANES];
+        size_t  plane_length[VIDEO_MAX_PLANES];
+};
+
+// CKim - Heap allocations made by the capture loop, collected only when
+// built with USBVIDEO_ALLOC_TRACKING. See alloctracker.h
+struct alloc_stats {
+        unsigned long   frames;         // frames processed since StartCapture()
+        unsigned long   steadyFrames;   // frames processed after the warm-up
+        unsigned long   allocFrames;    // steady state frames that allocated
+        uint64_t        allocs;         // steady state allocation count
+        uint64_t        bytes;          // steady state bytes allocated
+        uint64_t        maxAllocs;      // worst single frame, count
+        uint64_t        maxBytes;       // worst single frame, bytes
+};
+
+// CKim - Scheduling of the capture thread. QThread priorities are ignored under
+// the default SCHED_OTHER policy on Linux, so the policy is set explicitly.
+// SCHED_FIFO / SCHED_RR and mlockall need CAP_SYS_NICE / CAP_IPC_LOCK (or root)
+struct rt_config {
+        int     policy;         // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+        int     priority;       // 1..99, only used by SCHED_FIFO and SCHED_RR
+        int     captureCpu;     // CPU the capture thread is pinned to, -1 for any
+        cpu_set_t decodeCpus;   // CPUs of the denoise workers, empty for those the process started with
+        bool    lockMemory;     // mlockall() before streaming starts
+        bool    prefault;       // touch every page of the mmap buffers after mapping
+};
+
+// CKim - Dequeue interval of the capture loop, measured with CLOCK_MONOTONIC
+struct jitter_stats {
+        uint64_t        lastNs;         // time of the previous dequeue, 0 if none yet
+        unsigned long   count;          // number of intervals measured
+        unsigned long   late;           // intervals longer than 1.5x the nominal one
+        double          sumUs;
+        double          sumSqUs;
+        double          minUs;
+        double          maxUs;
+        unsigned long   hist[JITTER_HIST_BINS];
 };
 
 enum io_method {
         IO_METHOD_READ,
         IO_METHOD_MMAP,
         IO_METHOD_USERPTR,
+        IO_METHOD_FILE,         // frames loaded by OpenFrameFile(), no device
 };
 
 class UsbVideo : public QThread
@@ -62,6 +129,8 @@ public:
     UsbVideo(QObject* parent=0);
 
     int OpenDevice(const char* dev_name);
+    int OpenFrameFile(const char* file_name, int width, int height, unsigned int pixelformat,
+                      double frameIntervalUs = 0, unsigned long maxFrames = 0);
     int InitializeDevice(io_method a, int format = 0);
     int StartCapture();
     int StopCapture();
@@ -74,16 +143,37 @@ public:
     void PrintCapability();
     void PrintInputInfo();
     void PrintFormatInfo();
+    void PrintAllocStats();
+    void PrintJitterReport();
+
+    void SetRealtimeConfig(const rt_config& cfg)    {   m_rtConfig = cfg;   }
+
+    // CKim - Temporal noise reduction after decode, 0 turns it off. Safe to call while capturing.
+    void SetDenoiseStrength(int strength)           {   m_denoiseStrength = strength;   }
+
+    // CKim - Save the next frame to 'fileName', or the sharpest of the next 'burst' frames.
+    // Returns at once, snapshotSaved() or reportError() follows when the file is written.
+    int RequestSnapshot(const QString& fileName, int burst = 1);
+
+    // CKim - Number of identical frames before frozenStream() is emitted, 0 never reports
+    void SetFrozenThreshold(int frames)             {   m_frozenThreshold = frames;     }
 
     const QString&  GetErrStr()     {   return m_errStr;    }
     const QString&  GetMsgStr()     {   return m_msgStr;    }
 
     void  GetFrameSize(int& width, int& height)  {   width = m_pixformat.width;   height = m_pixformat.height; }
+    const alloc_stats& GetAllocStats()  {   return m_allocStats;    }
+    const jitter_stats& GetJitterStats()    {   return m_jitterStats;   }
+    unsigned long GetRepeatedFrames()       {   return m_repeatedFrames;    }
+    uint64_t GetLastNewFrameNs()            {   return m_lastNewFrameNs;    }
 
 signals:
     void renderedImage(const QImage &image);
     void reportError(const QString& str);
     void timeoutError();
+    void frozenStream(int frames);
+    void streamResumed();
+    void snapshotSaved(const QString& path);
 
 protected:
     void run() override;
@@ -97,8 +187,11 @@ protected:
     int m_numBuffers;
     struct v4l2_capability  m_cap;
     struct v4l2_format      m_format;
-    struct v4l2_pix_format  m_pixformat;
+    struct v4l2_pix_format  m_pixformat;            // CKim - for multi-planar devices filled from m_pixformatMp
+    struct v4l2_pix_format_mplane m_pixformatMp;
+    enum v4l2_buf_type      m_bufType;              // CKim - V4L2_BUF_TYPE_VIDEO_CAPTURE or _MPLANE
     struct buffer*  m_buffers;
+    int m_buffersCapacity;
 
     bool runThread;
 
@@ -107,6 +200,21 @@ protected:
 
     int init_mmap();
     int process_image(void *p, int size);
+    int process_planes(const buffer& b, const struct v4l2_plane* planes, int numPlanes);
+    int process_yuv420(const uint8_t* y, int yStride, const uint8_t* u, const uint8_t* v, int uvStride);
+    QImage& nextPoolImage(int width, int height);
+    void runFileFed();
+    int findFreePoolImage();
+    QImage& nextPoolImage();
+    void applyDenoise(QImage& image);
+    bool isRepeatedFrame(const void* p, int size);
+    void accumulateAllocStats(const alloc_counters& before);
+    void applyRealtimeConfig();
+    void accumulateJitter();
+    void accountFrame(int bytes, int64_t sequence);
+    void deliverImage(QImage& image);
+    void latchSnapshot();
+    void considerSnapshot(const void* p, int size, const struct timeval& timestamp, uint32_t sequence);
 
     //void StreamingThread();
     int decodeFrame();
@@ -114,7 +222,63 @@ protected:
     QString m_errStr;
     QString m_msgStr;
     QImage  m_convertedImage;
-    QImage  m_renderedImage;
+
+    // CKim - Decoded images are recycled once the GUI has released them,
+    // so the steady state does not allocate a new frame every time
+    QImage  m_imagePool[IMAGE_POOL_SIZE];
+    int     m_poolIndex;
+
+    // CKim - JPEG source kept across frames. Only the format handler is recreated by setDevice().
+    QBuffer         m_jpegBuffer;
+    QImageReader    m_jpegReader;
+
+    alloc_stats m_allocStats;
+
+    // CKim - Strength is written by the GUI thread, the denoiser is only used by the capture thread
+    TemporalDenoiser    m_denoiser;
+    volatile int        m_denoiseStrength;
+
+    // CKim - Repeated frame detection on the compressed payload
+    uint64_t        m_lastFrameHash;
+    int             m_lastFrameSize;        // -1 if there is no previous frame
+    int             m_repeatCount;          // identical frames in the current run
+    int             m_frozenThreshold;
+    bool            m_frozenReported;
+    unsigned long   m_repeatedFrames;       // total frames skipped since StartCapture()
+    uint64_t        m_lastNewFrameNs;       // CLOCK_MONOTONIC time of the last changed frame
+
+    // CKim - Bookkeeping for the shared metrics, see metrics.h
+    int64_t         m_lastSequence;         // driver sequence of the previous frame, -1 if none
+    uint64_t        m_decodeStartNs;
+    uint64_t        m_rateStartNs;
+    uint64_t        m_rateBytes;
+
+    // CKim - Snapshot requested by the GUI thread, picked up by the capture thread at the next frame
+    QMutex          m_snapMutex;
+    volatile bool   m_snapRequested;
+    QString         m_snapPath;
+    int             m_snapBurst;
+
+    // CKim - Burst in progress, only touched by the capture thread
+    int             m_snapRemaining;        // frames still to compare
+    bool            m_snapThisFrame;        // current frame takes part, see latchSnapshot()
+    bool            m_snapHaveCandidate;
+    double          m_frameSharpness;       // of the frame just delivered, -1 if not measured
+    QImage*         m_frameImage;           // the frame just delivered, NULL if none
+    const void*     m_framePayload;         // payload of a single plane multi-planar buffer, NULL if none
+    int             m_framePayloadSize;
+    snapshot_job    m_snapJob;              // best frame of the burst so far
+    SnapshotWriter  m_snapWriter;
+
+    rt_config       m_rtConfig;
+    bool            m_memoryLocked;
+    double          m_frameIntervalUs;      // negotiated with VIDIOC_G_PARM, 0 if unknown
+    jitter_stats    m_jitterStats;
+
+    // CKim - File-fed source. Frames are stored back to back as
+    // [4 byte little endian length][payload], m_buffers point into m_fileData
+    unsigned char*  m_fileData;
+    unsigned long   m_fileMaxFrames;    // stop after this many frames, 0 loops forever
 
 };
 